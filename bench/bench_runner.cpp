@@ -0,0 +1,383 @@
+/**
+ * @file bench_runner.cpp
+ * @brief Runs the benchmark programs through the interpreter and reports JSON
+ *
+ * Every program is run RUNS times as a separate `code PROGRAM` process with
+ * its standard output discarded. For each program the report gives the
+ * median, minimum and maximum wall time, the peak resident set size over
+ * all runs (from wait4) and the median number of allocations and requested
+ * bytes (counted by the libbench_alloc.so shim when --shim is given). A
+ * run fails if the interpreter exits with a non-zero status, i.e. a form
+ * raised RuntimeError. Directories are expanded to their *.scm files.
+ *
+ * usage: bench_runner --code PATH [--shim PATH] [--runs N] [--out FILE]
+ *                     [--record FILE | --baseline FILE [--tolerance PCT]
+ *                     [--mem-tolerance PCT] [--rss-tolerance PCT]] PROGRAM|DIR...
+ *
+ * The JSON goes to FILE (or stdout); a summary table goes to stderr.
+ * --record writes the report as the new baseline. --baseline compares the
+ * run with a baseline written by --record: a benchmark regresses when its
+ * fastest run (min_ms, which is far less sensitive to scheduling noise than
+ * the median) slows down by more than PCT percent (default 10), its
+ * allocation count or allocated bytes by more than the memory tolerance
+ * (default 2, the counts are nearly deterministic), or its peak RSS by
+ * more than the RSS tolerance (default 10: most of a few MB of RSS is the
+ * mapped binary and libraries, which move by hundreds of kB with code
+ * size alone). The comparison is printed as a table and the runner exits
+ * 1 on any regression. Wall times are only comparable on the machine that
+ * recorded the baseline.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+struct RunResult {
+    double ms;
+    long rss_kb;
+    unsigned long allocations;
+    unsigned long bytes;
+    bool ok;
+};
+
+struct Report {
+    std::string name;
+    double median_ms, min_ms, max_ms;
+    long peak_rss_kb;
+    unsigned long allocations, allocated_bytes;
+    bool ok;
+};
+
+static bool isDirectory(const std::string &path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+static void collectPrograms(const std::string &path, std::vector<std::string> &out) {
+    if (!isDirectory(path)) {
+        out.push_back(path);
+        return;
+    }
+    DIR *dir = opendir(path.c_str());
+    if (dir == nullptr) return;
+    std::vector<std::string> found;
+    while (struct dirent *entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name.size() > 4 && name.compare(name.size() - 4, 4, ".scm") == 0)
+            found.push_back(path + "/" + name);
+    }
+    closedir(dir);
+    std::sort(found.begin(), found.end());
+    out.insert(out.end(), found.begin(), found.end());
+}
+
+static std::string baseName(const std::string &path) {
+    size_t slash = path.rfind('/');
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    if (name.size() > 4 && name.compare(name.size() - 4, 4, ".scm") == 0)
+        name.erase(name.size() - 4);
+    return name;
+}
+
+static RunResult runOnce(const std::string &code, const std::string &shim,
+                         const std::string &program, const std::string &alloc_file) {
+    RunResult result = {0, 0, 0, 0, false};
+    unlink(alloc_file.c_str());
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid < 0) return result;
+    if (pid == 0) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        if (null_fd >= 0) dup2(null_fd, STDOUT_FILENO);
+        if (!shim.empty()) {
+            setenv("LD_PRELOAD", shim.c_str(), 1);
+            setenv("BENCH_ALLOC_OUT", alloc_file.c_str(), 1);
+        }
+        execl(code.c_str(), code.c_str(), program.c_str(), (char *)nullptr);
+        _exit(127);
+    }
+    int status = 0;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0) return result;
+    auto end = std::chrono::steady_clock::now();
+    result.ms = std::chrono::duration<double, std::milli>(end - start).count();
+    result.rss_kb = usage.ru_maxrss;
+    result.ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    if (!shim.empty()) {
+        FILE *f = fopen(alloc_file.c_str(), "r");
+        if (f != nullptr) {
+            if (fscanf(f, "%lu %lu", &result.allocations, &result.bytes) != 2)
+                result.allocations = result.bytes = 0;
+            fclose(f);
+        }
+    }
+    return result;
+}
+
+template <typename T>
+static T median(std::vector<T> values) {
+    std::sort(values.begin(), values.end());
+    size_t n = values.size();
+    return n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+static Report measure(const std::string &code, const std::string &shim,
+                      const std::string &program, int runs, const std::string &alloc_file) {
+    Report report;
+    report.name = baseName(program);
+    report.ok = true;
+    report.peak_rss_kb = 0;
+    std::vector<double> times;
+    std::vector<unsigned long> counts, bytes;
+    for (int i = 0; i < runs; i++) {
+        RunResult r = runOnce(code, shim, program, alloc_file);
+        if (!r.ok) report.ok = false;
+        times.push_back(r.ms);
+        counts.push_back(r.allocations);
+        bytes.push_back(r.bytes);
+        report.peak_rss_kb = std::max(report.peak_rss_kb, r.rss_kb);
+    }
+    report.median_ms = median(times);
+    report.min_ms = *std::min_element(times.begin(), times.end());
+    report.max_ms = *std::max_element(times.begin(), times.end());
+    report.allocations = median(counts);
+    report.allocated_bytes = median(bytes);
+    return report;
+}
+
+static std::string jsonEscape(const std::string &s) {
+    std::string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+static void writeJson(FILE *out, const std::vector<Report> &reports, int runs) {
+    fprintf(out, "{\n  \"runs\": %d,\n  \"benchmarks\": [\n", runs);
+    for (size_t i = 0; i < reports.size(); i++) {
+        const Report &r = reports[i];
+        fprintf(out,
+                "    {\"name\": \"%s\", \"median_ms\": %.2f, \"min_ms\": %.2f, \"max_ms\": %.2f, "
+                "\"peak_rss_kb\": %ld, \"allocations\": %lu, \"allocated_bytes\": %lu, \"ok\": %s}%s\n",
+                jsonEscape(r.name).c_str(), r.median_ms, r.min_ms, r.max_ms, r.peak_rss_kb,
+                r.allocations, r.allocated_bytes, r.ok ? "true" : "false",
+                i + 1 < reports.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+// ============================================================================
+// Baseline comparison
+// ============================================================================
+
+static bool readFile(const std::string &path, std::string &text) {
+    FILE *f = fopen(path.c_str(), "r");
+    if (f == nullptr) return false;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) text.append(buf, n);
+    fclose(f);
+    return true;
+}
+
+static double numberField(const std::string &object, const char *key) {
+    std::string pattern = std::string("\"") + key + "\":";
+    size_t pos = object.find(pattern);
+    if (pos == std::string::npos) return -1;
+    return strtod(object.c_str() + pos + pattern.size(), nullptr);
+}
+
+/**
+ * @brief Reads the benchmarks of a report written by writeJson
+ *
+ * Only the format this tool writes is understood: one object per line,
+ * starting with its name.
+ */
+static bool readBaseline(const std::string &path, std::vector<Report> &reports) {
+    std::string text;
+    if (!readFile(path, text)) return false;
+    const std::string marker = "{\"name\": \"";
+    size_t pos = 0;
+    while ((pos = text.find(marker, pos)) != std::string::npos) {
+        size_t name_start = pos + marker.size();
+        size_t name_end = text.find('"', name_start);
+        size_t object_end = text.find('}', name_start);
+        if (name_end == std::string::npos || object_end == std::string::npos) break;
+        std::string object = text.substr(pos, object_end - pos);
+        Report r;
+        r.name = text.substr(name_start, name_end - name_start);
+        r.median_ms = numberField(object, "median_ms");
+        r.min_ms = numberField(object, "min_ms");
+        r.max_ms = numberField(object, "max_ms");
+        r.peak_rss_kb = (long)numberField(object, "peak_rss_kb");
+        r.allocations = (unsigned long)numberField(object, "allocations");
+        r.allocated_bytes = (unsigned long)numberField(object, "allocated_bytes");
+        r.ok = object.find("\"ok\": true") != std::string::npos;
+        reports.push_back(r);
+        pos = object_end;
+    }
+    return true;
+}
+
+static const Report *findReport(const std::vector<Report> &reports, const std::string &name) {
+    for (const Report &r : reports)
+        if (r.name == name) return &r;
+    return nullptr;
+}
+
+/**
+ * @brief Prints one row of the diff table, returns true on a regression
+ */
+static bool compareMetric(const std::string &name, const char *metric, double base, double current,
+                          double tolerance) {
+    double change = base > 0 ? (current - base) * 100.0 / base : 0;
+    const char *status = "";
+    bool regressed = false;
+    if (change > tolerance) {
+        status = "REGRESSION";
+        regressed = true;
+    } else if (change < -tolerance) {
+        status = "improved";
+    }
+    int decimals = strstr(metric, "_ms") != nullptr ? 1 : 0;
+    fprintf(stderr, "%-14s %-16s %14.*f %14.*f %+8.1f%%  %s\n", name.c_str(), metric, decimals, base,
+            decimals, current, change, status);
+    return regressed;
+}
+
+static bool compareWithBaseline(const std::vector<Report> &baseline, const std::vector<Report> &reports,
+                                double time_tolerance, double mem_tolerance, double rss_tolerance) {
+    bool regressed = false;
+    fprintf(stderr, "\n%-14s %-16s %14s %14s %9s\n", "benchmark", "metric", "baseline", "current", "change");
+    for (const Report &r : reports) {
+        const Report *base = findReport(baseline, r.name);
+        if (base == nullptr) {
+            fprintf(stderr, "%-14s (not in baseline)\n", r.name.c_str());
+            continue;
+        }
+        if (!r.ok) {
+            fprintf(stderr, "%-14s %-16s %14s %14s %9s  REGRESSION\n", r.name.c_str(), "ok", "true", "false", "");
+            regressed = true;
+            continue;
+        }
+        regressed |= compareMetric(r.name, "min_ms", base->min_ms, r.min_ms, time_tolerance);
+        regressed |= compareMetric(r.name, "peak_rss_kb", base->peak_rss_kb, r.peak_rss_kb, rss_tolerance);
+        // 没有加载分配统计时两边都是 0，不参与比较
+        if (base->allocations != 0 && r.allocations != 0) {
+            regressed |= compareMetric(r.name, "allocations", base->allocations, r.allocations, mem_tolerance);
+            regressed |= compareMetric(r.name, "allocated_bytes", base->allocated_bytes, r.allocated_bytes,
+                                       mem_tolerance);
+        }
+    }
+    for (const Report &base : baseline)
+        if (findReport(reports, base.name) == nullptr)
+            fprintf(stderr, "%-14s (in baseline, not run)\n", base.name.c_str());
+    fprintf(stderr, regressed ? "\nperformance regression against baseline\n" : "\nno regression against baseline\n");
+    return !regressed;
+}
+
+// Writes the JSON report to path, or to stdout when path is empty
+static bool writeReport(const std::string &path, const std::vector<Report> &reports, int runs) {
+    if (path.empty()) {
+        writeJson(stdout, reports, runs);
+        return true;
+    }
+    FILE *out = fopen(path.c_str(), "w");
+    if (out == nullptr) {
+        perror(path.c_str());
+        return false;
+    }
+    writeJson(out, reports, runs);
+    fclose(out);
+    fprintf(stderr, "wrote %s\n", path.c_str());
+    return true;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s --code PATH [--shim PATH] [--runs N] [--out FILE]\n"
+            "       [--record FILE | --baseline FILE [--tolerance PCT] [--mem-tolerance PCT]\n"
+            "       [--rss-tolerance PCT]] PROGRAM|DIR...\n",
+            prog);
+}
+
+int main(int argc, char *argv[]) {
+    std::string code, shim, out_path, record_path, baseline_path;
+    int runs = 5;
+    double time_tolerance = 10, mem_tolerance = 2, rss_tolerance = 10;
+    std::vector<std::string> programs;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--code" && i + 1 < argc) {
+            code = argv[++i];
+        } else if (arg == "--shim" && i + 1 < argc) {
+            shim = argv[++i];
+        } else if (arg == "--runs" && i + 1 < argc) {
+            runs = atoi(argv[++i]);
+        } else if (arg == "--out" && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (arg == "--record" && i + 1 < argc) {
+            record_path = argv[++i];
+        } else if (arg == "--baseline" && i + 1 < argc) {
+            baseline_path = argv[++i];
+        } else if (arg == "--tolerance" && i + 1 < argc) {
+            time_tolerance = strtod(argv[++i], nullptr);
+        } else if (arg == "--mem-tolerance" && i + 1 < argc) {
+            mem_tolerance = strtod(argv[++i], nullptr);
+        } else if (arg == "--rss-tolerance" && i + 1 < argc) {
+            rss_tolerance = strtod(argv[++i], nullptr);
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            usage(argv[0]);
+            return 2;
+        } else {
+            collectPrograms(arg, programs);
+        }
+    }
+    if (code.empty() || programs.empty() || runs < 1 || (!record_path.empty() && !baseline_path.empty())) {
+        usage(argv[0]);
+        return 2;
+    }
+    std::vector<Report> baseline;
+    if (!baseline_path.empty() && !readBaseline(baseline_path, baseline)) {
+        perror(baseline_path.c_str());
+        return 2;
+    }
+
+    std::string alloc_file = "/tmp/bench_alloc." + std::to_string(getpid());
+    std::vector<Report> reports;
+    bool all_ok = true;
+    fprintf(stderr, "%-14s %10s %10s %10s %12s %14s\n", "benchmark", "median ms", "min ms", "max ms", "peak rss kB", "allocations");
+    for (const std::string &program : programs) {
+        Report r = measure(code, shim, program, runs, alloc_file);
+        fprintf(stderr, "%-14s %10.1f %10.1f %10.1f %12ld %14lu%s\n", r.name.c_str(), r.median_ms,
+                r.min_ms, r.max_ms, r.peak_rss_kb, r.allocations, r.ok ? "" : "  FAILED");
+        all_ok = all_ok && r.ok;
+        reports.push_back(r);
+    }
+    unlink(alloc_file.c_str());
+
+    if (!writeReport(out_path, reports, runs)) return 2;
+    if (!record_path.empty()) {
+        // 失败的程序不能作为基线
+        if (!all_ok) {
+            fprintf(stderr, "not recording a baseline: some programs failed\n");
+            return 1;
+        }
+        if (!writeReport(record_path, reports, runs)) return 2;
+    }
+    if (!baseline_path.empty())
+        return compareWithBaseline(baseline, reports, time_tolerance, mem_tolerance, rss_tolerance) ? 0 : 1;
+    return all_ok ? 0 : 1;
+}
@@ -0,0 +1,45 @@
+#!/bin/sh
+# Fork-join fib with futures versus plain recursion, by thread count.
+#
+# Below CUTOFF the recursion is sequential so each future carries enough
+# work to be worth scheduling.
+#
+# usage: bench/future_bench.sh [path/to/code (./build/code)] [n] [cutoff] [max-threads]
+
+CODE=${1:-./build/code}
+N=${2:-22}
+CUTOFF=${3:-14}
+MAX=${4:-$(nproc)}
+
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+
+cat > "$tmp/seq.scm" <<SCM
+(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))
+(fib $N)
+SCM
+cat > "$tmp/par.scm" <<SCM
+(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))
+(define (pfib n)
+  (if (< n $CUTOFF)
+      (fib n)
+      (let ((a (future (pfib (- n 1)))))
+        (let ((b (pfib (- n 2))))
+          (+ (touch a) b)))))
+(pfib $N)
+SCM
+
+run() {
+    s=$(date +%s%N)
+    "$@" > /dev/null || exit 1
+    e=$(date +%s%N)
+    awk -v ns="$((e - s))" 'BEGIN { printf "%.3f", ns / 1e9 }'
+}
+
+echo "variant threads seconds"
+echo "sequential 1 $(run "$CODE" "$tmp/seq.scm")"
+t=1
+while [ "$t" -le "$MAX" ]; do
+    echo "futures $t $(run "$CODE" --threads "$t" "$tmp/par.scm")"
+    t=$((t * 2))
+done
@@ -0,0 +1,56 @@
+/**
+ * @file green_switch.cpp
+ * @brief Context switch rate of green threads
+ *
+ * THREADS green threads each yield ROUNDS times, first through the C++
+ * interface (raw switch cost) and then from Scheme code, and the number
+ * of switches per second is reported for both.
+ *
+ * usage: green_switch [threads] [rounds]
+ */
+
+#include "interpreter.hpp"
+#include "green.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+
+int main(int argc, char *argv[]) {
+    int threads = argc > 1 ? std::atoi(argv[1]) : 2;
+    int rounds = argc > 2 ? std::atoi(argv[2]) : 1000000;
+    typedef std::chrono::steady_clock clock;
+
+    int finished = 0;
+    for (int t = 0; t < threads; t++) {
+        greenSpawn([&]() {
+            for (int i = 0; i < rounds; i++) greenYield();
+            finished++;
+        });
+    }
+    clock::time_point t0 = clock::now();
+    while (finished < threads) greenYield();
+    double raw = std::chrono::duration<double>(clock::now() - t0).count();
+    double raw_switches = (double)threads * rounds + rounds;
+    std::printf("raw:    threads=%d switches=%.0f seconds=%.3f switches_per_s=%.0f\n",
+                threads, raw_switches, raw, raw_switches / raw);
+
+    // The evaluator has no tail calls, so the Scheme loop is split into blocks
+    // of 200 yields to keep the recursion shallow on the green stacks
+    int blocks = rounds / 10 / 200 > 0 ? rounds / 10 / 200 : 1;
+    int scheme_rounds = blocks * 200;
+    std::ostringstream src;
+    src << "(define done (make-channel " << threads << "))\n"
+        << "(define (spin n) (if (= n 0) 0 (begin (yield) (spin (- n 1)))))\n"
+        << "(define (blocks k) (if (= k 0) (channel-put! done #t) (begin (spin 200) (blocks (- k 1)))))\n"
+        << "(define (wait k) (if (= k 0) 0 (begin (channel-get done) (wait (- k 1)))))\n";
+    for (int t = 0; t < threads; t++) src << "(spawn blocks " << blocks << ")\n";
+    Interpreter interp;
+    t0 = clock::now();
+    interp.eval(src.str() + "(wait " + std::to_string(threads) + ")");
+    double scm = std::chrono::duration<double>(clock::now() - t0).count();
+    double scm_switches = (double)threads * scheme_rounds;
+    std::printf("scheme: threads=%d switches=%.0f seconds=%.3f switches_per_s=%.0f\n",
+                threads, scm_switches, scm, scm_switches / scm);
+    return 0;
+}
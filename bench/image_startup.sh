@@ -0,0 +1,49 @@
+#!/bin/sh
+# Time-to-first-eval with and without a heap image.
+#
+# Generates a prelude of DEFS procedure definitions plus a table computed
+# at load time, then compares starting from source (prelude + probe) with
+# starting from an image saved after the prelude (--image + probe). Each
+# variant is run RUNS times and the best wall time is reported.
+#
+# usage: bench/image_startup.sh [path/to/code (./build/code)] [defs] [runs]
+
+CODE=${1:-./build/code}
+DEFS=${2:-5000}
+RUNS=${3:-5}
+
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+
+awk -v n="$DEFS" 'BEGIN {
+    for (i = 0; i < n; i++)
+        printf "(define (f%d x) (if (< x %d) (+ x 1) (* x 2)))\n", i, i
+    print "(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))"
+    print "(define (table n) (if (= n 0) (quote ()) (cons (fib n) (table (- n 1)))))"
+    print "(define fibs (table 18))"
+}' > "$tmp/prelude.scm"
+printf '(car fibs)\n' > "$tmp/probe.scm"
+cat "$tmp/prelude.scm" "$tmp/probe.scm" > "$tmp/full.scm"
+
+cat "$tmp/prelude.scm" > "$tmp/save.scm"
+printf '(save-image "%s")\n' "$tmp/prelude.img" >> "$tmp/save.scm"
+"$CODE" "$tmp/save.scm" > /dev/null || exit 1
+
+best() {
+    b=
+    r=0
+    while [ "$r" -lt "$RUNS" ]; do
+        s=$(date +%s%N)
+        "$@" > /dev/null || exit 1
+        e=$(date +%s%N)
+        t=$(( (e - s) / 1000000 ))
+        if [ -z "$b" ] || [ "$t" -lt "$b" ]; then b=$t; fi
+        r=$(( r + 1 ))
+    done
+    echo "$b"
+}
+
+source_ms=$(best "$CODE" "$tmp/full.scm")
+image_ms=$(best "$CODE" --image "$tmp/prelude.img" "$tmp/probe.scm")
+echo "defs=$DEFS image_bytes=$(wc -c < "$tmp/prelude.img")"
+echo "from_source_ms=$source_ms from_image_ms=$image_ms"
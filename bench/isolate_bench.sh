@@ -0,0 +1,67 @@
+#!/bin/sh
+# Sharded workload on isolates, by isolate count.
+#
+# The main program deals SHARDS shards of (fib N) round-robin to the
+# isolates and sums the replies. Isolates share no values, so the only
+# cross-thread traffic is the message queues; with enough cores the time
+# should fall linearly with the isolate count.
+#
+# usage: bench/isolate_bench.sh [path/to/code (./build/code)] [shards] [n] [max-isolates]
+
+CODE=${1:-./build/code}
+SHARDS=${2:-64}
+N=${3:-18}
+MAX=${4:-$(nproc)}
+
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+
+cat > "$tmp/shard.scm" <<SCM
+(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))
+(define parent (isolate-parent))
+(define (serve)
+  (let ((n (isolate-receive)))
+    (if (eq? n 'stop)
+        (void)
+        (begin (isolate-send! parent (fib n)) (serve)))))
+(serve)
+SCM
+
+cat > "$tmp/seq.scm" <<SCM
+(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))
+(define (run k acc) (if (= k 0) acc (run (- k 1) (+ acc (fib $N)))))
+(run $SHARDS 0)
+SCM
+
+# Driver for $1 isolates
+driver() {
+    cat > "$tmp/isolates.scm" <<SCM
+(define (start k acc) (if (= k 0) acc (start (- k 1) (cons (make-isolate "$tmp/shard.scm") acc))))
+(define isolates (start $1 '()))
+(define (deal k ring)
+  (cond ((= k 0) (void))
+        ((null? ring) (deal k isolates))
+        (else (isolate-send! (car ring) $N) (deal (- k 1) (cdr ring)))))
+(define (collect k acc) (if (= k 0) acc (collect (- k 1) (+ acc (isolate-receive)))))
+(deal $SHARDS isolates)
+(display (collect $SHARDS 0))
+(define (stop ring) (if (null? ring) (void) (begin (isolate-send! (car ring) 'stop) (stop (cdr ring)))))
+(stop isolates)
+SCM
+}
+
+run() {
+    s=$(date +%s%N)
+    "$@" > /dev/null || exit 1
+    e=$(date +%s%N)
+    awk -v ns="$((e - s))" 'BEGIN { printf "%.3f", ns / 1e9 }'
+}
+
+echo "variant isolates seconds"
+echo "sequential 0 $(run "$CODE" "$tmp/seq.scm")"
+i=1
+while [ "$i" -le "$MAX" ]; do
+    driver "$i"
+    echo "isolates $i $(run "$CODE" "$tmp/isolates.scm")"
+    i=$((i * 2))
+done
@@ -0,0 +1,33 @@
+#!/bin/sh
+# Throughput of --jobs versus thread count.
+#
+# Generates SCRIPTS independent CPU-bound scripts sharing one prelude and
+# runs them with --jobs 1, 2, 4, ... up to MAX threads, reporting scripts
+# per second for each thread count.
+#
+# usage: bench/jobs_bench.sh [path/to/code (./build/code)] [scripts] [max-threads]
+
+CODE=${1:-./build/code}
+SCRIPTS=${2:-64}
+MAX=${3:-$(nproc)}
+
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+
+PRELUDE='(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))'
+i=0
+while [ "$i" -lt "$SCRIPTS" ]; do
+    printf '(define (run k acc) (if (= k 0) acc (run (- k 1) (+ acc (fib 14)))))\n(run 20 %d)\n' "$i" > "$tmp/s$i.scm"
+    i=$((i + 1))
+done
+
+echo "threads seconds scripts_per_s"
+t=1
+while [ "$t" -le "$MAX" ]; do
+    s=$(date +%s%N)
+    "$CODE" --jobs "$t" -e "$PRELUDE" "$tmp"/s*.scm > /dev/null || exit 1
+    e=$(date +%s%N)
+    ns=$((e - s))
+    echo "$t $(awk -v ns="$ns" 'BEGIN { printf "%.3f", ns / 1e9 }') $(awk -v n="$SCRIPTS" -v ns="$ns" 'BEGIN { printf "%.1f", n * 1e9 / ns }')"
+    t=$((t * 2))
+done
@@ -0,0 +1,40 @@
+#!/bin/sh
+# Automatic parallel evaluation of pure operands, by cost threshold.
+#
+# The workload mixes a recursive call (always above the threshold) with
+# calls to a small non-recursive helper whose estimated cost is about 40;
+# thresholds below that also spawn tasks for the helper calls. Pick the
+# smallest threshold whose time does not get worse.
+#
+# usage: bench/parallel_args_bench.sh [path/to/code (./build/code)] [n] [threads]
+
+CODE=${1:-./build/code}
+N=${2:-24}
+THREADS=${3:-$(nproc)}
+
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+
+cat > "$tmp/work.scm" <<SCM
+(define (poly x) (+ (* x x x) (* 3 x x) (* 5 x) 7 (* x (- x 1)) (* (+ x 1) (+ x 2))))
+(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))
+(define (mix n)
+  (if (< n 2)
+      (list (poly n) (poly (+ n 1)))
+      (list (car (mix (- n 1))) (car (mix (- n 2))) (poly n) (poly (- n 1)))))
+(fib $N)
+(mix (- $N 4))
+SCM
+
+run() {
+    s=$(date +%s%N)
+    "$@" > /dev/null || exit 1
+    e=$(date +%s%N)
+    awk -v ns="$((e - s))" 'BEGIN { printf "%.3f", ns / 1e9 }'
+}
+
+echo "variant threads cost seconds"
+echo "sequential 1 - $(run "$CODE" "$tmp/work.scm")"
+for cost in 8 32 128 256 1024; do
+    echo "parallel-args $THREADS $cost $(run "$CODE" --threads "$THREADS" --parallel-args --parallel-args-cost "$cost" "$tmp/work.scm")"
+done
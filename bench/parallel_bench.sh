@@ -0,0 +1,40 @@
+#!/bin/sh
+# parallel-map speedup versus --threads.
+#
+# Maps a CPU-bound procedure over ITEMS list elements with map-style
+# recursion (sequential baseline) and with parallel-map at 1, 2, 4, ...
+# up to MAX threads.
+#
+# usage: bench/parallel_bench.sh [path/to/code (./build/code)] [items] [max-threads]
+
+CODE=${1:-./build/code}
+ITEMS=${2:-200}
+MAX=${3:-$(nproc)}
+
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+
+cat > "$tmp/common.scm" <<SCM
+(define (range a b) (if (>= a b) (quote ()) (cons a (range (+ a 1) b))))
+(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))
+(define (work x) (fib (+ 10 (modulo x 6))))
+(define (smap f l) (if (null? l) (quote ()) (cons (f (car l)) (smap f (cdr l)))))
+(define items (range 0 $ITEMS))
+SCM
+{ cat "$tmp/common.scm"; echo '(car (smap work items))'; } > "$tmp/seq.scm"
+{ cat "$tmp/common.scm"; echo '(car (parallel-map work items))'; } > "$tmp/par.scm"
+
+run() {
+    s=$(date +%s%N)
+    "$@" > /dev/null || exit 1
+    e=$(date +%s%N)
+    awk -v ns="$((e - s))" 'BEGIN { printf "%.3f", ns / 1e9 }'
+}
+
+echo "variant threads seconds"
+echo "map 1 $(run "$CODE" "$tmp/seq.scm")"
+t=1
+while [ "$t" -le "$MAX" ]; do
+    echo "parallel-map $t $(run "$CODE" --threads "$t" "$tmp/par.scm")"
+    t=$((t * 2))
+done
@@ -0,0 +1,9 @@
+; Ackermann function: deep non-tail recursion
+(define (ack m n)
+  (cond ((= m 0) (+ n 1))
+        ((= n 0) (ack (- m 1) 1))
+        (else (ack (- m 1) (ack m (- n 1))))))
+(define (repeat k acc)
+  (if (= k 0) acc (repeat (- k 1) (ack 2 9))))
+(display (ack 3 5))
+(display (repeat 300 0))
@@ -0,0 +1,20 @@
+; Closure-heavy code: counters, composition and Church numerals
+(define (make-counter)
+  (let ((n 0))
+    (lambda () (set! n (+ n 1)) n)))
+(define (compose f g) (lambda (x) (f (g x))))
+(define (church n)
+  (if (= n 0)
+      (lambda (f) (lambda (x) x))
+      (let ((prev (church (- n 1))))
+        (lambda (f) (lambda (x) (f ((prev f) x)))))))
+(define (unchurch c) ((c (lambda (x) (+ x 1))) 0))
+(define (count-up counter k)
+  (if (= k 0) (counter) (begin (counter) (count-up counter (- k 1)))))
+(define (run k acc)
+  (if (= k 0)
+      acc
+      (run (- k 1) (+ acc (unchurch (church 50))
+                      ((compose (lambda (x) (* x 2)) (lambda (x) (+ x 1))) k)))))
+(display (count-up (make-counter) 2000))
+(display (run 1000 0))
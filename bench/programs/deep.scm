@@ -0,0 +1,8 @@
+; Deep non-tail recursion: long chains of pending frames
+(define (build n)
+  (if (= n 0) '() (cons n (build (- n 1)))))
+(define (len l)
+  (if (null? l) 0 (+ 1 (len (cdr l)))))
+(define (run k acc)
+  (if (= k 0) acc (run (- k 1) (+ acc (len (build 5000))))))
+(display (run 8 0))
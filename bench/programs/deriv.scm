@@ -0,0 +1,23 @@
+; Symbolic differentiation (Gabriel's deriv): symbols, quoted data and consing
+(define (map1 f l)
+  (if (null? l) '() (cons (f (car l)) (map1 f (cdr l)))))
+(define (deriv a)
+  (cond ((not (pair? a))
+         (if (eq? a 'x) 1 0))
+        ((eq? (car a) '+)
+         (cons '+ (map1 deriv (cdr a))))
+        ((eq? (car a) '-)
+         (cons '- (map1 deriv (cdr a))))
+        ((eq? (car a) '*)
+         (list '* a (cons '+ (map1 (lambda (a) (list '/ (deriv a) a)) (cdr a)))))
+        ((eq? (car a) '/)
+         (list '- (list '/ (deriv (car (cdr a))) (car (cdr (cdr a))))
+               (list '/ (car (cdr a))
+                     (list '* (car (cdr (cdr a))) (car (cdr (cdr a)))
+                           (deriv (car (cdr (cdr a))))))))
+        (else 'error)))
+(define (run k result)
+  (if (= k 0)
+      result
+      (run (- k 1) (deriv '(+ (* 3 x x) (* a x x) (* b x) 5)))))
+(display (run 1000 '()))
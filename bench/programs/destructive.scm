@@ -0,0 +1,26 @@
+; Destructive list operations (after Gabriel's destruc): set-car! and set-cdr! in place
+(define (make-list n fill)
+  (if (= n 0) '() (cons fill (make-list (- n 1) fill))))
+(define (reverse! l)
+  (letrec ((loop (lambda (l acc)
+                   (if (null? l)
+                       acc
+                       (let ((next (cdr l)))
+                         (set-cdr! l acc)
+                         (loop next l))))))
+    (loop l '())))
+(define (fill! l k)
+  (if (null? l)
+      'done
+      (begin (set-car! l (+ (car l) k))
+             (fill! (cdr l) (+ k 1)))))
+(define (sum l acc)
+  (if (null? l) acc (sum (cdr l) (+ acc (car l)))))
+(define cells (make-list 1000 0))
+(define (run k)
+  (if (= k 0)
+      (sum cells 0)
+      (begin (fill! cells 1)
+             (set! cells (reverse! cells))
+             (run (- k 1)))))
+(display (run 40))
@@ -0,0 +1,20 @@
+; Count all solutions of the 7 queens problem: list construction and backtracking
+(define (ok? row dist placed)
+  (if (null? placed)
+      #t
+      (and (not (= (car placed) (+ row dist)))
+           (not (= (car placed) (- row dist)))
+           (not (= (car placed) row))
+           (ok? row (+ dist 1) (cdr placed)))))
+(define (iota1 n)
+  (if (= n 0) '() (cons n (iota1 (- n 1)))))
+(define (try candidates rest placed)
+  (if (null? candidates)
+      (if (null? rest) 1 0)
+      (+ (if (ok? (car candidates) 1 placed)
+             (try (append2 (cdr candidates) rest) '() (cons (car candidates) placed))
+             0)
+         (try (cdr candidates) (cons (car candidates) rest) placed))))
+(define (append2 a b)
+  (if (null? a) b (cons (car a) (append2 (cdr a) b))))
+(display (try (iota1 7) '() '()))
@@ -0,0 +1,7 @@
+; Exact rational arithmetic: harmonic numbers with normalisation on every step
+(define (harmonic n acc)
+  (if (= n 0) acc (harmonic (- n 1) (+ acc (/ 1 n)))))
+(define (run k acc)
+  (if (= k 0) acc (run (- k 1) (harmonic 15 0))))
+(display (run 6000 0))
+(display (* (/ 3 4) (/ 8 9) (/ 27 2)))
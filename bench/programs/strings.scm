@@ -0,0 +1,14 @@
+; Output building: string and symbol values written through display
+(define (emit k)
+  (if (= k 0)
+      'done
+      (begin (display "item ")
+             (display k)
+             (display ": ")
+             (display "some text that is written many times")
+             (display 'sym)
+             (display "\n")
+             (emit (- k 1)))))
+(define (run k)
+  (if (= k 0) 'done (begin (emit 2000) (run (- k 1)))))
+(run 20)
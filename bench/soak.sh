@@ -0,0 +1,46 @@
+#!/bin/sh
+# Long-input soak benchmark for the streaming batch mode.
+#
+# Feeds a generated script of FORMS top-level forms (redefinitions, calls
+# and list building) through `code --stream` on stdin and samples the
+# resident set size once per INTERVAL seconds. With bounded buffers the
+# RSS column should stay flat for the whole run.
+#
+# usage: bench/soak.sh [path/to/code (./build/code)] [forms] [interval]
+
+CODE=${1:-./build/code}
+FORMS=${2:-10000000}
+INTERVAL=${3:-1}
+
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+mkfifo "$tmp/in"
+
+awk -v n="$FORMS" 'BEGIN {
+    for (i = 0; i < n; i += 4) {
+        k = i % 97
+        printf "(define (f%d x) (+ x %d))\n", k, k
+        printf "(define v%d (list %d %d %d))\n", k, i, k, i
+        printf "(f%d %d)\n", k, i
+        printf "(car (cdr v%d))\n", k
+    }
+}' > "$tmp/in" &
+
+start=$(date +%s)
+"$CODE" --stream < "$tmp/in" > /dev/null &
+pid=$!
+
+echo "elapsed_s rss_kb"
+max=0
+while kill -0 "$pid" 2>/dev/null; do
+    rss=$(awk '/^VmRSS:/ { print $2 }' "/proc/$pid/status" 2>/dev/null)
+    if [ -n "$rss" ]; then
+        echo "$(( $(date +%s) - start )) $rss"
+        [ "$rss" -gt "$max" ] && max=$rss
+    fi
+    sleep "$INTERVAL"
+done
+wait "$pid"
+status=$?
+echo "forms=$FORMS seconds=$(( $(date +%s) - start )) max_rss_kb=$max exit=$status"
+exit $status
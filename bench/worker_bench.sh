@@ -0,0 +1,42 @@
+#!/bin/sh
+# Worker mode throughput and latency versus one process per request.
+#
+# Starts `code --socket` with a generated prelude of DEFS definitions and
+# drives it with worker_load (CLIENTS connections x REQUESTS requests),
+# then times the same request run as a fresh process that reloads the
+# prelude every time.
+#
+# usage: bench/worker_bench.sh [build-dir (./build)] [defs] [clients] [requests]
+
+BUILD=${1:-./build}
+DEFS=${2:-2000}
+CLIENTS=${3:-4}
+REQUESTS=${4:-2000}
+EXPR='(define (sq x) (* x x)) (f7 (sq 12))'
+
+tmp=$(mktemp -d) || exit 1
+trap 'kill "$pid" 2>/dev/null; rm -rf "$tmp"' EXIT
+
+awk -v n="$DEFS" 'BEGIN {
+    for (i = 0; i < n; i++)
+        printf "(define (f%d x) (if (< x %d) (+ x 1) (* x 2)))\n", i, i
+}' > "$tmp/prelude.scm"
+
+"$BUILD/code" --socket "$tmp/worker.sock" "$tmp/prelude.scm" &
+pid=$!
+while [ ! -S "$tmp/worker.sock" ]; do sleep 0.05; done
+
+echo "== worker ($DEFS defs in prelude)"
+"$BUILD/worker_load" "$tmp/worker.sock" "$CLIENTS" "$REQUESTS" "$EXPR"
+
+echo "== process per request"
+printf '%s\n' "$EXPR" > "$tmp/request.scm"
+runs=50
+s=$(date +%s%N)
+i=0
+while [ "$i" -lt "$runs" ]; do
+    "$BUILD/code" -e "$(cat "$tmp/prelude.scm")" "$tmp/request.scm" > /dev/null
+    i=$((i + 1))
+done
+e=$(date +%s%N)
+echo "requests=$runs rps=$(( runs * 1000000000 / (e - s) )) mean_us=$(( (e - s) / runs / 1000 ))"
@@ -0,0 +1,129 @@
+/**
+ * @file worker_load.cpp
+ * @brief Load generator for the worker mode socket
+ *
+ * Opens CLIENTS connections to a worker started with `code --socket PATH`,
+ * sends REQUESTS framed requests on each (one outstanding request per
+ * connection) and reports throughput and latency percentiles.
+ *
+ * usage: worker_load PATH [clients] [requests] [expr]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static bool writeAll(int fd, const std::string &data) {
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = write(fd, data.data() + done, data.size() - done);
+        if (n <= 0) return false;
+        done += n;
+    }
+    return true;
+}
+
+static bool readAll(int fd, char *buf, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = read(fd, buf + done, len - done);
+        if (n <= 0) return false;
+        done += n;
+    }
+    return true;
+}
+
+static std::string frame(const std::string &payload) {
+    uint32_t n = (uint32_t)payload.size();
+    std::string f;
+    f.push_back((char)(n >> 24));
+    f.push_back((char)(n >> 16));
+    f.push_back((char)(n >> 8));
+    f.push_back((char)n);
+    return f + payload;
+}
+
+static int connectTo(const char *path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    if (fd < 0 || connect(fd, (sockaddr *)&addr, sizeof(addr)) != 0) {
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: %s PATH [clients] [requests] [expr]\n", argv[0]);
+        return 2;
+    }
+    const char *path = argv[1];
+    int clients = argc > 2 ? std::atoi(argv[2]) : 4;
+    int requests = argc > 3 ? std::atoi(argv[3]) : 2000;
+    std::string request = frame(argc > 4 ? argv[4] : "(define (sq x) (* x x)) (sq 12)");
+
+    typedef std::chrono::steady_clock clock;
+    std::vector<std::vector<double>> latencies(clients);
+    std::vector<int> errors(clients, 0);
+    std::vector<std::thread> threads;
+    clock::time_point start = clock::now();
+    for (int c = 0; c < clients; c++) {
+        threads.push_back(std::thread([&, c]() {
+            int fd = connectTo(path);
+            if (fd < 0) {
+                errors[c] = requests;
+                return;
+            }
+            std::vector<char> body;
+            for (int i = 0; i < requests; i++) {
+                clock::time_point t0 = clock::now();
+                char header[4];
+                if (!writeAll(fd, request) || !readAll(fd, header, 4)) {
+                    errors[c] += requests - i;
+                    break;
+                }
+                const unsigned char *u = reinterpret_cast<const unsigned char *>(header);
+                uint32_t n = ((uint32_t)u[0] << 24) | ((uint32_t)u[1] << 16) | ((uint32_t)u[2] << 8) | u[3];
+                body.resize(n);
+                if (!readAll(fd, body.data(), n)) {
+                    errors[c] += requests - i;
+                    break;
+                }
+                if (n == 0 || body[0] != 'o') errors[c]++;
+                latencies[c].push_back(std::chrono::duration<double, std::micro>(clock::now() - t0).count());
+            }
+            close(fd);
+        }));
+    }
+    for (auto &t : threads) t.join();
+    double seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+    std::vector<double> all;
+    int failed = 0;
+    for (int c = 0; c < clients; c++) {
+        all.insert(all.end(), latencies[c].begin(), latencies[c].end());
+        failed += errors[c];
+    }
+    if (all.empty()) {
+        std::fprintf(stderr, "no responses (is the worker listening on %s?)\n", path);
+        return 1;
+    }
+    std::sort(all.begin(), all.end());
+    std::printf("clients=%d requests=%zu errors=%d seconds=%.3f\n", clients, all.size(), failed, seconds);
+    std::printf("rps=%.0f p50_us=%.1f p99_us=%.1f max_us=%.1f\n", all.size() / seconds,
+                all[all.size() / 2], all[(all.size() * 99) / 100], all.back());
+    return failed == 0 ? 0 : 1;
+}
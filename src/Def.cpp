@@ -22,10 +22,15 @@
  * - List operations: cons, car, cdr, list, set-car!, set-cdr!
  * - Logic: not, and, or (and/or support short-circuit evaluation)
  * - Type predicates: eq?, boolean?, number?, null?, pair?, procedure?, symbol?, list?, string?
- * - I/O: display
+ * - I/O: display, flush-output, command-line
+ * - Parallel: parallel-map, parallel-for-each, parallel-reduce, touch
+ * - Green threads: spawn, yield, make-channel, channel-put!, channel-get
+ * - Isolates: make-isolate, isolate-send!, isolate-receive, isolate-parent
+ * - Diagnostics: allocation-stats, with-perf-counters
  * - Control: void, exit
  */
-std::map<std::string, ExprType> primitives = {
+extern const std::map<std::string, ExprType> primitives;
+const std::map<std::string, ExprType> primitives = {
     // Arithmetic operations
     {"+",        E_PLUS},
     {"-",        E_MINUS},
@@ -67,6 +72,31 @@ std::map<std::string, ExprType> primitives = {
     
     // I/O operations
     {"display",   E_DISPLAY},
+    {"flush-output", E_FLUSH},
+    {"command-line", E_COMMAND_LINE},
+
+    // Parallel operations
+    {"parallel-map",      E_PARALLEL_MAP},
+    {"parallel-for-each", E_PARALLEL_FOR_EACH},
+    {"parallel-reduce",   E_PARALLEL_REDUCE},
+    {"touch",             E_TOUCH},
+
+    // Green threads
+    {"spawn",        E_SPAWN},
+    {"yield",        E_YIELD},
+    {"make-channel", E_MAKE_CHANNEL},
+    {"channel-put!", E_CHANNEL_PUT},
+    {"channel-get",  E_CHANNEL_GET},
+
+    // Isolates
+    {"make-isolate",    E_MAKE_ISOLATE},
+    {"isolate-send!",   E_ISOLATE_SEND},
+    {"isolate-receive", E_ISOLATE_RECEIVE},
+    {"isolate-parent",  E_ISOLATE_PARENT},
+
+    // Diagnostics
+    {"allocation-stats",   E_ALLOCATION_STATS},
+    {"with-perf-counters", E_WITH_PERF_COUNTERS},
     
     // Special values and control
     {"void",      E_VOID},
@@ -87,11 +117,15 @@ std::map<std::string, ExprType> primitives = {
  * - Variable and function definition: define
  * - Binding constructs: let, letrec
  * - Assignment: set!
+ * - Images: save-image (needs the calling environment)
+ * - Parallelism: future (its expression is evaluated later, possibly on another thread)
+ * - Diagnostics: time (its body is evaluated between measurements)
  * 
  * Note: and/or have been moved to primitives to support function-style usage
  * while maintaining their short-circuit evaluation behavior.
  */
-std::map<std::string, ExprType> reserved_words = {
+extern const std::map<std::string, ExprType> reserved_words;
+const std::map<std::string, ExprType> reserved_words = {
     // Control flow constructs
     {"begin",   E_BEGIN},    
     {"quote",   E_QUOTE},    
@@ -111,5 +145,14 @@ std::map<std::string, ExprType> reserved_words = {
     {"letrec",  E_LETREC},   
     
     // Assignment
-    {"set!",    E_SET}      
+    {"set!",    E_SET},
+
+    // Images
+    {"save-image", E_SAVE_IMAGE},
+
+    // Parallelism
+    {"future",  E_FUTURE},
+
+    // Diagnostics
+    {"time",    E_TIME}
 };
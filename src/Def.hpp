@@ -101,6 +101,32 @@ enum ExprType {
 
     // I/O operations
     E_DISPLAY,         
+    E_FLUSH,
+    E_COMMAND_LINE,
+
+    // Parallel operations
+    E_PARALLEL_MAP,
+    E_PARALLEL_FOR_EACH,
+    E_PARALLEL_REDUCE,
+    E_FUTURE,
+    E_TOUCH,
+    E_SPAWN,
+    E_YIELD,
+    E_MAKE_CHANNEL,
+    E_CHANNEL_PUT,
+    E_CHANNEL_GET,
+    E_MAKE_ISOLATE,
+    E_ISOLATE_SEND,
+    E_ISOLATE_RECEIVE,
+    E_ISOLATE_PARENT,
+
+    // Images
+    E_SAVE_IMAGE,
+
+    // Diagnostics
+    E_ALLOCATION_STATS,
+    E_TIME,
+    E_WITH_PERF_COUNTERS,
 };
 
 /**
@@ -118,6 +144,10 @@ enum ValueType {
     V_STRING,           
     V_PAIR,             
     V_PROC,             
+    V_PRIMITIVE,
+    V_FUTURE,
+    V_CHANNEL,
+    V_ISOLATE,
     V_VOID,            
     V_TERMINATE        
 };
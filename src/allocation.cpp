@@ -0,0 +1,142 @@
+/**
+ * @file allocation.cpp
+ * @brief Implementation of allocation accounting
+ */
+
+#include "allocation.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+thread_local AllocationCounters allocation_counters;
+
+namespace {
+
+const char *const KIND_NAMES[ALLOC_KINDS] = {
+    "integer", "rational", "boolean", "symbol", "null", "string", "pair", "procedure",
+    "primitive", "future", "channel", "isolate", "void", "terminate", "environment-frame"
+};
+
+bool report_at_exit = false;
+
+struct Totals {
+    unsigned long objects[ALLOC_KINDS];
+    unsigned long bytes[ALLOC_KINDS];
+};
+
+/**
+ * @brief Counters of live threads and totals of exited ones, never destroyed
+ */
+struct Registry {
+    std::mutex lock;
+    std::vector<AllocationCounters *> live;
+    Totals retired;
+    Registry() : retired() {}
+};
+
+Registry &registry() {
+    static Registry *instance = new Registry();
+    return *instance;
+}
+
+void add(Totals &into, const AllocationCounters &c) {
+    for (int k = 0; k < ALLOC_KINDS; k++) {
+        into.objects[k] += __atomic_load_n(&c.objects[k], __ATOMIC_RELAXED);
+        into.bytes[k] += __atomic_load_n(&c.bytes[k], __ATOMIC_RELAXED);
+    }
+}
+
+// Moves the thread's counts to the retired totals when it exits
+struct Unregister {
+    ~Unregister() {
+        Registry &r = registry();
+        std::lock_guard<std::mutex> guard(r.lock);
+        add(r.retired, allocation_counters);
+        r.live.erase(std::remove(r.live.begin(), r.live.end(), &allocation_counters), r.live.end());
+    }
+};
+
+Totals totals() {
+    Registry &r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    Totals t = r.retired;
+    for (AllocationCounters *c : r.live) add(t, *c);
+    return t;
+}
+
+int saturate(unsigned long n) {
+    return n > (unsigned long)INT_MAX ? INT_MAX : (int)n;
+}
+
+} // namespace
+
+void registerAllocationCounters() {
+    allocation_counters.registered = true;
+    {
+        Registry &r = registry();
+        std::lock_guard<std::mutex> guard(r.lock);
+        r.live.push_back(&allocation_counters);
+    }
+    static thread_local Unregister unregister;
+    (void)unregister;
+}
+
+unsigned long threadAllocatedBytes() {
+    unsigned long total = 0;
+    for (int k = 0; k < ALLOC_KINDS; k++) total += allocation_counters.bytes[k];
+    return total;
+}
+
+unsigned long threadAllocatedObjects(int first, int last) {
+    unsigned long total = 0;
+    for (int k = first; k < last; k++) total += allocation_counters.objects[k];
+    return total;
+}
+
+const char *allocationKindName(int kind) {
+    return KIND_NAMES[kind];
+}
+
+void enableAllocationReport() {
+    report_at_exit = true;
+}
+
+bool allocationReportEnabled() {
+    return report_at_exit;
+}
+
+void printAllocationStats(std::ostream &os) {
+    Totals t = totals();
+    unsigned long objects = 0, bytes = 0;
+    for (int k = 0; k < ALLOC_KINDS; k++) {
+        objects += t.objects[k];
+        bytes += t.bytes[k];
+    }
+    char line[128];
+    snprintf(line, sizeof(line), "allocations: %lu objects, %lu bytes\n", objects, bytes);
+    os << line;
+    snprintf(line, sizeof(line), "%-18s %14s %16s %8s %8s\n", "kind", "objects", "bytes", "avg", "bytes %");
+    os << line;
+    for (int k = 0; k < ALLOC_KINDS; k++) {
+        if (t.objects[k] == 0) continue;
+        snprintf(line, sizeof(line), "%-18s %14lu %16lu %8.1f %7.1f%%\n", KIND_NAMES[k], t.objects[k], t.bytes[k],
+                 (double)t.bytes[k] / t.objects[k], bytes == 0 ? 0.0 : t.bytes[k] * 100.0 / bytes);
+        os << line;
+    }
+    os.flush();
+}
+
+Value allocationStatsPrimitive(const std::vector<Value> &args) {
+    (void)args;
+    Totals t = totals();
+    Value result = NullV();
+    for (int k = ALLOC_KINDS - 1; k >= 0; k--) {
+        if (t.objects[k] == 0) continue;
+        Value row = PairV(SymbolV(KIND_NAMES[k]),
+                          PairV(IntegerV(saturate(t.objects[k])), PairV(IntegerV(saturate(t.bytes[k])), NullV())));
+        result = PairV(row, result);
+    }
+    return result;
+}
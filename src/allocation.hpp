@@ -0,0 +1,69 @@
+#ifndef ALLOCATION_HPP
+#define ALLOCATION_HPP
+
+/**
+ * @file allocation.hpp
+ * @brief Objects and bytes allocated per value type and for environment frames
+ *
+ * Every value factory and extend count what they create in counters of
+ * the allocating thread; there is no switch, counting is two relaxed
+ * stores next to the allocation. The counters only grow. They are summed
+ * over all threads, including ones that have exited, by:
+ *
+ *   (allocation-stats)   list of (kind objects bytes), e.g. (pair 1200 38400),
+ *                        for every kind allocated so far; numbers saturate
+ *                        at the largest fixnum
+ *   --alloc-stats        the same as a table on stderr at exit
+ *
+ * With --profile the bytes allocated while a procedure body is active are
+ * also reported per procedure (see profile.hpp).
+ */
+
+#include "Def.hpp"
+#include "value.hpp"
+#include <cstddef>
+#include <ostream>
+
+// Environment frames (AssocList) are counted after the value types
+const int ALLOC_FRAME = V_TERMINATE + 1;
+const int ALLOC_KINDS = ALLOC_FRAME + 1;
+
+/**
+ * @brief Counters of one thread, written only by that thread
+ *
+ * Plain words accessed with relaxed __atomic builtins, which stay inline
+ * even in unoptimized builds; other threads only read them.
+ */
+struct AllocationCounters {
+    unsigned long objects[ALLOC_KINDS];
+    unsigned long bytes[ALLOC_KINDS];
+    bool registered;
+};
+
+extern thread_local AllocationCounters allocation_counters;
+
+void registerAllocationCounters();
+
+inline void countAllocation(int kind, size_t bytes) {
+    AllocationCounters &c = allocation_counters;
+    if (__builtin_expect(!c.registered, 0)) registerAllocationCounters();
+    __atomic_store_n(&c.objects[kind], c.objects[kind] + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&c.bytes[kind], c.bytes[kind] + bytes, __ATOMIC_RELAXED);
+}
+
+// Bytes allocated so far by the calling thread
+unsigned long threadAllocatedBytes();
+
+// Objects of the kinds [first, last) allocated so far by the calling thread
+unsigned long threadAllocatedObjects(int first, int last);
+
+// "integer", "pair", ..., "environment-frame"
+const char *allocationKindName(int kind);
+
+void enableAllocationReport();
+bool allocationReportEnabled();
+void printAllocationStats(std::ostream &);
+
+Value allocationStatsPrimitive(const std::vector<Value> &args);
+
+#endif // ALLOCATION_HPP
@@ -0,0 +1,173 @@
+/**
+ * @file envstats.cpp
+ * @brief Implementation of the environment lookup statistics
+ */
+
+#include "envstats.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+bool env_stats = false;
+
+namespace {
+
+// 0..15 exactly, then 16-31, 32-63, ... up to the width of unsigned long
+const int EXACT_BUCKETS = 16;
+const int BUCKETS = EXACT_BUCKETS + 64 - 4;
+const int TOP_VARIABLES = 20;
+
+int bucketOf(unsigned long hops) {
+    if (hops < (unsigned long)EXACT_BUCKETS) return (int)hops;
+    return EXACT_BUCKETS + (63 - __builtin_clzl(hops)) - 4;
+}
+
+struct VariableCounts {
+    unsigned long walks;
+    unsigned long hops;
+    unsigned long misses;
+};
+
+struct Tables {
+    unsigned long lookups[BUCKETS];
+    unsigned long updates[BUCKETS];
+    std::unordered_map<std::string, VariableCounts> variables;
+    Tables() : lookups(), updates() {}
+};
+
+void merge(Tables &into, const Tables &from) {
+    for (int b = 0; b < BUCKETS; b++) {
+        into.lookups[b] += from.lookups[b];
+        into.updates[b] += from.updates[b];
+    }
+    for (auto &item : from.variables) {
+        VariableCounts &c = into.variables[item.first];
+        c.walks += item.second.walks;
+        c.hops += item.second.hops;
+        c.misses += item.second.misses;
+    }
+}
+
+/**
+ * @brief Tables of one thread; the lock is only contended while the report is printed
+ */
+struct ThreadTables {
+    std::mutex lock;
+    Tables tables;
+};
+
+struct Registry {
+    std::mutex lock;
+    std::vector<ThreadTables *> live;
+    Tables retired;
+};
+
+Registry &registry() {
+    static Registry *instance = new Registry();
+    return *instance;
+}
+
+thread_local ThreadTables *thread_tables = nullptr;
+
+// Moves the thread's counts to the retired tables when it exits
+struct Unregister {
+    ~Unregister() {
+        Registry &r = registry();
+        std::lock_guard<std::mutex> guard(r.lock);
+        merge(r.retired, thread_tables->tables);
+        r.live.erase(std::remove(r.live.begin(), r.live.end(), thread_tables), r.live.end());
+        delete thread_tables;
+        thread_tables = nullptr;
+    }
+};
+
+ThreadTables &threadTables() {
+    if (thread_tables == nullptr) {
+        thread_tables = new ThreadTables();
+        {
+            Registry &r = registry();
+            std::lock_guard<std::mutex> guard(r.lock);
+            r.live.push_back(thread_tables);
+        }
+        static thread_local Unregister unregister;
+        (void)unregister;
+    }
+    return *thread_tables;
+}
+
+std::string bucketLabel(int b) {
+    if (b < EXACT_BUCKETS) return std::to_string(b);
+    int shift = b - EXACT_BUCKETS + 4;
+    unsigned long low = 1UL << shift;
+    return std::to_string(low) + "-" + std::to_string(low * 2 - 1);
+}
+
+} // namespace
+
+void enableEnvStats() {
+    env_stats = true;
+}
+
+void countLookup(const std::string &name, unsigned long hops, bool found, bool update) {
+    ThreadTables &t = threadTables();
+    std::lock_guard<std::mutex> guard(t.lock);
+    (update ? t.tables.updates : t.tables.lookups)[bucketOf(hops)]++;
+    VariableCounts &c = t.tables.variables[name];
+    c.walks++;
+    c.hops += hops;
+    if (!found) c.misses++;
+}
+
+void printEnvStats(std::ostream &os) {
+    if (!env_stats) return;
+    Tables total;
+    {
+        Registry &r = registry();
+        std::lock_guard<std::mutex> guard(r.lock);
+        total = r.retired;
+        for (ThreadTables *t : r.live) {
+            std::lock_guard<std::mutex> table_guard(t->lock);
+            merge(total, t->tables);
+        }
+    }
+
+    unsigned long lookups = 0, updates = 0, hops = 0, misses = 0;
+    for (int b = 0; b < BUCKETS; b++) {
+        lookups += total.lookups[b];
+        updates += total.updates[b];
+    }
+    std::vector<std::pair<std::string, VariableCounts>> variables(total.variables.begin(), total.variables.end());
+    for (auto &item : variables) {
+        hops += item.second.hops;
+        misses += item.second.misses;
+    }
+    std::sort(variables.begin(), variables.end(),
+              [](const std::pair<std::string, VariableCounts> &a, const std::pair<std::string, VariableCounts> &b) {
+                  if (a.second.hops != b.second.hops) return a.second.hops > b.second.hops;
+                  return a.first < b.first;
+              });
+
+    char line[160];
+    unsigned long walks = lookups + updates;
+    snprintf(line, sizeof(line), "environment: %lu lookups, %lu updates, %lu hops (%.1f per walk), %lu not found\n",
+             lookups, updates, hops, walks == 0 ? 0.0 : (double)hops / walks, misses);
+    os << line;
+    snprintf(line, sizeof(line), "%-12s %14s %14s\n", "hops", "lookups", "updates");
+    os << line;
+    for (int b = 0; b < BUCKETS; b++) {
+        if (total.lookups[b] == 0 && total.updates[b] == 0) continue;
+        snprintf(line, sizeof(line), "%-12s %14lu %14lu\n", bucketLabel(b).c_str(), total.lookups[b], total.updates[b]);
+        os << line;
+    }
+    snprintf(line, sizeof(line), "%-24s %14s %16s %8s %10s\n", "variable", "walks", "hops", "avg", "not found");
+    os << line;
+    for (size_t i = 0; i < variables.size() && i < (size_t)TOP_VARIABLES; i++) {
+        const VariableCounts &c = variables[i].second;
+        snprintf(line, sizeof(line), "%-24s %14lu %16lu %8.1f %10lu\n", variables[i].first.c_str(), c.walks, c.hops,
+                 (double)c.hops / c.walks, c.misses);
+        os << line;
+    }
+    os.flush();
+}
@@ -0,0 +1,38 @@
+#ifndef ENVSTATS_HPP
+#define ENVSTATS_HPP
+
+/**
+ * @file envstats.hpp
+ * @brief Cost of environment lookups (--env-stats)
+ *
+ * find and modify walk the environment chain from the innermost binding
+ * outwards. With --env-stats every walk records its hops, the number of
+ * nodes passed before the binding was found (the whole chain when it was
+ * not, as for primitives referenced by name), in tables of the walking
+ * thread. At exit stderr receives:
+ *
+ *   - a histogram of hops per lookup (find) and per update (modify,
+ *     behind define and set!), exact up to 15 and by powers of two above
+ *   - the variables with the most cumulative hops, with their walks,
+ *     average hops and how many walks found nothing
+ *
+ * The parser's checks whether a keyword such as define is shadowed are
+ * lookups too and show up under the keyword.
+ *
+ * When it is off find and modify pay one predictable branch.
+ */
+
+#include <ostream>
+#include <string>
+
+extern bool env_stats;
+
+void enableEnvStats();
+
+// Records one walk for name that passed hops nodes
+void countLookup(const std::string &name, unsigned long hops, bool found, bool update);
+
+// Prints the report if --env-stats is on
+void printEnvStats(std::ostream &);
+
+#endif // ENVSTATS_HPP
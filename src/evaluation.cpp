@@ -14,54 +14,99 @@
 #include "expr.hpp"
 #include "RE.hpp"
 #include "syntax.hpp"
+#include "io.hpp"
+#include "image.hpp"
+#include "parallel.hpp"
+#include "future.hpp"
+#include "green.hpp"
+#include "isolate.hpp"
+#include "purity.hpp"
+#include "limits.hpp"
+#include "safepoint.hpp"
+#include "profile.hpp"
+#include "allocation.hpp"
+#include "perf.hpp"
+#include "histogram.hpp"
+#include "trace.hpp"
 #include <cstring>
 #include <vector>
 #include <map>
 #include <climits>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
 
-extern std::map<std::string, ExprType> primitives;
-extern std::map<std::string, ExprType> reserved_words;
+extern const std::map<std::string, ExprType> primitives;
+extern const std::map<std::string, ExprType> reserved_words;
 
 Value Fixnum::eval(Assoc &e) { // evaluation of a fixnum
+    if (__builtin_expect(expr_histogram, 0)) countEval(this);
     return IntegerV(n);
 }
 
 Value RationalNum::eval(Assoc &e) { // evaluation of a rational number
+    if (__builtin_expect(expr_histogram, 0)) countEval(this);
     return RationalV(numerator, denominator);
 }
 
 Value StringExpr::eval(Assoc &e) { // evaluation of a string
+    if (__builtin_expect(expr_histogram, 0)) countEval(this);
     return StringV(s);
 }
 
 Value True::eval(Assoc &e) { // evaluation of #t
+    if (__builtin_expect(expr_histogram, 0)) countEval(this);
     return BooleanV(true);
 }
 
 Value False::eval(Assoc &e) { // evaluation of #f
+    if (__builtin_expect(expr_histogram, 0)) countEval(this);
     return BooleanV(false);
 }
 
 Value MakeVoid::eval(Assoc &e) { // (void)
+    if (__builtin_expect(expr_histogram, 0)) countEval(this);
     return VoidV();
 }
 
 Value Exit::eval(Assoc &e) { // (exit)
+    if (__builtin_expect(expr_histogram, 0)) countEval(this);
     return TerminateV();
 }
 
 Value Unary::eval(Assoc &e) { // evaluation of single-operator primitive
+    if (__builtin_expect(expr_histogram, 0)) countEval(this);
     return evalRator(rand->eval(e));
 }
 
 Value Binary::eval(Assoc &e) { // evaluation of two-operators primitive
+    if (__builtin_expect(expr_histogram, 0)) countEval(this);
+    if (parallelArgsEnabled() && !plan.sequential.load(std::memory_order_relaxed)) {
+        const Expr rands[2] = {rand1, rand2};
+        std::vector<Value> args;
+        if (evalArgsInParallel(plan, rands, 2, e, args)) {
+            if (__builtin_expect(expr_histogram, 0)) countOperands(this, args[0], args[1]);
+            return evalRator(args[0], args[1]);
+        }
+    }
+    if (__builtin_expect(expr_histogram, 0)) {
+        Value left = rand1->eval(e);
+        Value right = rand2->eval(e);
+        countOperands(this, left, right);
+        return evalRator(left, right);
+    }
     return evalRator(rand1->eval(e), rand2->eval(e));
 }
 
 //****
 Value Variadic::eval(Assoc &e) { // evaluation of multi-operator primitive
+    if (__builtin_expect(expr_histogram, 0)) countEval(this);
     // TODO: TO COMPLETE THE VARIADIC CLASS
     std::vector<Value> evaluated_args;
+    if (parallelArgsEnabled() && !plan.sequential.load(std::memory_order_relaxed) &&
+        evalArgsInParallel(plan, rands.data(), rands.size(), e, evaluated_args)) {
+        return evalRator(evaluated_args);
+    }
     for (const auto &arg_expr : rands) {
         evaluated_args.push_back(arg_expr->eval(e));
     }
@@ -69,13 +114,168 @@ Value Variadic::eval(Assoc &e) { // evaluation of multi-operator primitive
 
 }
 
-Value Var::eval(Assoc &e) { // evaluation of variable
-    // TODO: TO identify the invalid variable
-    //当前环境查找，找到返回
-    // if (matched_value.get() != nullptr) {
-    //     return matched_value;
-    // }
+// ============================================================================
+// Primitive procedures as first-class values
+// ============================================================================
+
+bool check_true(const Value &v);
+
+// The evalRator methods do not touch their operand expressions, so a single
+// shared instance per operator is enough to reuse them on evaluated arguments.
+template <class Op>
+static Value unaryPrimitive(const std::vector<Value> &args) {
+    static Op op(Expr(nullptr));
+    return op.evalRator(args[0]);
+}
 
+template <class Op>
+static Value binaryPrimitive(const std::vector<Value> &args) {
+    static Op op(Expr(nullptr), Expr(nullptr));
+    return op.evalRator(args[0], args[1]);
+}
+
+template <class Op>
+static Value variadicPrimitive(const std::vector<Value> &args) {
+    static Op op{std::vector<Expr>()};
+    return op.evalRator(args);
+}
+
+static Value voidPrimitive(const std::vector<Value> &args) {
+    (void)args;
+    return VoidV();
+}
+
+static Value exitPrimitive(const std::vector<Value> &args) {
+    (void)args;
+    return TerminateV();
+}
+
+static Value flushPrimitive(const std::vector<Value> &args) {
+    (void)args;
+    outputStream().flush();
+    return VoidV();
+}
+
+static Value commandLinePrimitive(const std::vector<Value> &args) {
+    (void)args;
+    Value result = NullV();
+    const std::vector<std::string> &argv = commandLine();
+    for (size_t i = argv.size(); i > 0; i--) {
+        result = PairV(StringV(argv[i - 1]), result);
+    }
+    return result;
+}
+
+static Value andPrimitive(const std::vector<Value> &args) { // no short-circuit once evaluated
+    for (const auto &arg : args) {
+        if (!check_true(arg)) {
+            return BooleanV(false);
+        }
+    }
+    return args.empty() ? BooleanV(true) : args.back();
+}
+
+static Value orPrimitive(const std::vector<Value> &args) {
+    for (const auto &arg : args) {
+        if (check_true(arg)) {
+            return arg;
+        }
+    }
+    return BooleanV(false);
+}
+
+struct PrimitiveSpec {
+    PrimitiveFn fn;
+    int min_arity;
+    int max_arity;
+};
+
+static const std::map<ExprType, PrimitiveSpec> primitive_specs = {
+    {E_PLUS,     {variadicPrimitive<PlusVar>, 0, -1}},
+    {E_MINUS,    {variadicPrimitive<MinusVar>, 1, -1}},
+    {E_MUL,      {variadicPrimitive<MultVar>, 0, -1}},
+    {E_DIV,      {variadicPrimitive<DivVar>, 1, -1}},
+    {E_MODULO,   {binaryPrimitive<Modulo>, 2, 2}},
+    {E_EXPT,     {binaryPrimitive<Expt>, 2, 2}},
+
+    {E_LT,       {variadicPrimitive<LessVar>, 2, -1}},
+    {E_LE,       {variadicPrimitive<LessEqVar>, 2, -1}},
+    {E_EQ,       {variadicPrimitive<EqualVar>, 2, -1}},
+    {E_GE,       {variadicPrimitive<GreaterEqVar>, 2, -1}},
+    {E_GT,       {variadicPrimitive<GreaterVar>, 2, -1}},
+
+    {E_CONS,     {binaryPrimitive<Cons>, 2, 2}},
+    {E_CAR,      {unaryPrimitive<Car>, 1, 1}},
+    {E_CDR,      {unaryPrimitive<Cdr>, 1, 1}},
+    {E_LIST,     {variadicPrimitive<ListFunc>, 0, -1}},
+    {E_SETCAR,   {binaryPrimitive<SetCar>, 2, 2}},
+    {E_SETCDR,   {binaryPrimitive<SetCdr>, 2, 2}},
+
+    {E_NOT,      {unaryPrimitive<Not>, 1, 1}},
+    {E_AND,      {andPrimitive, 0, -1}},
+    {E_OR,       {orPrimitive, 0, -1}},
+
+    {E_EQQ,      {binaryPrimitive<IsEq>, 2, 2}},
+    {E_BOOLQ,    {unaryPrimitive<IsBoolean>, 1, 1}},
+    {E_INTQ,     {unaryPrimitive<IsFixnum>, 1, 1}},
+    {E_NULLQ,    {unaryPrimitive<IsNull>, 1, 1}},
+    {E_PAIRQ,    {unaryPrimitive<IsPair>, 1, 1}},
+    {E_PROCQ,    {unaryPrimitive<IsProcedure>, 1, 1}},
+    {E_SYMBOLQ,  {unaryPrimitive<IsSymbol>, 1, 1}},
+    {E_LISTQ,    {unaryPrimitive<IsList>, 1, 1}},
+    {E_STRINGQ,  {unaryPrimitive<IsString>, 1, 1}},
+
+    {E_DISPLAY,  {unaryPrimitive<Display>, 1, 1}},
+    {E_FLUSH,    {flushPrimitive, 0, 0}},
+    {E_COMMAND_LINE, {commandLinePrimitive, 0, 0}},
+
+    {E_PARALLEL_MAP,      {parallelMapPrimitive, 2, 2}},
+    {E_PARALLEL_FOR_EACH, {parallelForEachPrimitive, 2, 2}},
+    {E_PARALLEL_REDUCE,   {parallelReducePrimitive, 3, 3}},
+    {E_TOUCH,             {touchPrimitive, 1, 1}},
+
+    {E_SPAWN,        {spawnPrimitive, 1, -1}},
+    {E_YIELD,        {yieldPrimitive, 0, 0}},
+    {E_MAKE_CHANNEL, {makeChannelPrimitive, 0, 1}},
+    {E_CHANNEL_PUT,  {channelPutPrimitive, 2, 2}},
+    {E_CHANNEL_GET,  {channelGetPrimitive, 1, 1}},
+
+    {E_MAKE_ISOLATE,    {makeIsolatePrimitive, 1, 1}},
+    {E_ISOLATE_SEND,    {isolateSendPrimitive, 2, 2}},
+    {E_ISOLATE_RECEIVE, {isolateReceivePrimitive, 0, 0}},
+    {E_ISOLATE_PARENT,  {isolateParentPrimitive, 0, 0}},
+
+    {E_ALLOCATION_STATS,   {allocationStatsPrimitive, 0, 0}},
+    {E_WITH_PERF_COUNTERS, {withPerfCountersPrimitive, 1, 1}},
+
+    {E_VOID,     {voidPrimitive, 0, 0}},
+    {E_EXIT,     {exitPrimitive, 0, 0}},
+};
+
+/**
+ * @brief Returns the procedure value bound to a primitive name
+ *
+ * One Primitive value is created per name on first use and shared by every
+ * lookup afterwards, so `(eq? car car)` holds and no closure is allocated.
+ */
+static Value primitiveValue(const std::string &name) {
+    static const std::map<std::string, Value> values = [] {
+        std::map<std::string, Value> table;
+        for (const auto &entry : primitives) {
+            auto spec = primitive_specs.find(entry.second);
+            if (spec != primitive_specs.end()) {
+                table.insert({entry.first, PrimitiveV(entry.first, spec->second.fn,
+                                                      spec->second.min_arity, spec->second.max_arity)});
+            }
+        }
+        return table;
+    }();
+    auto it = values.find(name);
+    return it == values.end() ? Value(nullptr) : it->second;
+}
+
+Value Var::eval(Assoc &e) { // evaluation of variable
+    if (__builtin_expect(expr_histogram, 0)) countEval(this);
     if (x.empty()) {
             throw RuntimeError("Empty expression");
         }
@@ -92,50 +292,11 @@ Value Var::eval(Assoc &e) { // evaluation of variable
     if (matched_value.get()!=nullptr) {
         return matched_value;
     }
-        //内置函数，创建闭包返回
-
-        if (primitives.count(x)) {
-            std::cout << "Found primitive: " << x << std::endl;
-            static std::map<ExprType, std::pair<Expr, std::vector<std::string>>> primitive_map = {
-                {E_VOID,     {new MakeVoid(), {}}},
-                {E_EXIT,     {new Exit(), {}}},
-                {E_BOOLQ,    {new IsBoolean(new Var("parm")), {"parm"}}},
-                {E_INTQ,     {new IsFixnum(new Var("parm")), {"parm"}}},
-                {E_NULLQ,    {new IsNull(new Var("parm")), {"parm"}}},
-                {E_PAIRQ,    {new IsPair(new Var("parm")), {"parm"}}},
-                {E_PROCQ,    {new IsProcedure(new Var("parm")), {"parm"}}},
-                {E_SYMBOLQ,  {new IsSymbol(new Var("parm")), {"parm"}}},
-                {E_STRINGQ,  {new IsString(new Var("parm")), {"parm"}}},
-                {E_DISPLAY,  {new Display(new Var("parm")), {"parm"}}},
-
-               {E_PLUS,     {new Plus(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},  // 改为二元 Plus
-               {E_MINUS,    {new Minus(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}}, // 改为二元 Minus
-               {E_MUL,      {new Mult(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},  // 改为二元 Mult
-               {E_DIV,      {new Div(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},   // 改为二元 Div
-               {E_MODULO,   {new Modulo(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
-               {E_EXPT,     {new Expt(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
-               {E_EQQ,      {new IsEq(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},  // 改为二元 IsEq
-               {E_LT,       {new Less(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},  // 添加比较运算符
-               {E_LE,       {new LessEq(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
-               {E_EQ,       {new Equal(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
-               {E_GE,       {new GreaterEq(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
-               {E_GT,       {new Greater(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
-               {E_CONS,     {new Cons(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},  // 添加 cons
-               {E_CAR,      {new Car(new Var("parm")), {"parm"}}},                               // 添加 car
-               {E_CDR,      {new Cdr(new Var("parm")), {"parm"}}},                               // 添加 cdr
-               {E_NOT,      {new Not(new Var("parm")), {"parm"}}},                               // 添加 not
-               {E_SETCAR,   {new SetCar(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}}, // 添加 set-car!
-               {E_SETCDR,   {new SetCdr(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}}, // 添加 set-cdr!
-             };
-
-            auto it = primitive_map.find(primitives[x]);
-            //TOD0:to PASS THE parameters correctly;
-            //COMPLETE THE CODE WITH THE HINT IN IF SENTENCE WITH CORRECT RETURN VALUE
-            if (it != primitive_map.end()) {
-                //TODO
-                return ProcedureV(it->second.second, it->second.first,e);
-            }
-        }
+    //内置函数，返回共享的原生过程对象
+    Value prim = primitiveValue(x);
+    if (prim.get() != nullptr) {
+        return prim;
+    }
 
     throw RuntimeError("Variable " + x + " not defined");
 }
@@ -898,6 +1059,7 @@ Value SetCar::evalRator(const Value &rand1, const Value &rand2) { // set-car!
     }
     //将Value转换为Pair指针，指向实际的pair对象
     auto pair = dynamic_cast<Pair*>(rand1.get());
+    checkPairMutable(pair, "set-car!");
     pair->car = rand2;
     return VoidV();
 }
@@ -908,6 +1070,7 @@ Value SetCdr::evalRator(const Value &rand1, const Value &rand2) { // set-cdr!
         throw RuntimeError("Wrong typename");
     }
     auto pair = dynamic_cast<Pair*>(rand1.get());
+    checkPairMutable(pair, "set-cdr!");
     pair->cdr = rand2;
 
     return VoidV();
@@ -952,7 +1115,7 @@ Value IsPair::evalRator(const Value &rand) { // pair?
 }
 
 Value IsProcedure::evalRator(const Value &rand) { // procedure?
-    return BooleanV(rand->v_type == V_PROC);
+    return BooleanV(rand->v_type == V_PROC || rand->v_type == V_PRIMITIVE);
 }
 
 Value IsSymbol::evalRator(const Value &rand) { // symbol?
@@ -964,6 +1127,7 @@ Value IsString::evalRator(const Value &rand) { // string?
 }
 
 Value Begin::eval(Assoc &e) {
+    if (__builtin_expect(expr_histogram, 0)) countEval(this);
     //TODO: To complete the begin logic
     //begin全面修改，过于简化，只能处理普通表达式序列
     // Value result = VoidV();//创建一个表示空的值对象作为初始结果
@@ -994,8 +1158,11 @@ Value Begin::eval(Assoc &e) {
     }
 
     if (internal_defs.empty()) {
+        chargeStep();
         Value result = es[0]->eval(e);
         for (size_t i = 1; i < es.size(); i++) {
+            safepointPoll();
+            chargeStep();
             Value temp = es[i]->eval(e);
             result = temp;
         }
@@ -1021,9 +1188,12 @@ Value Begin::eval(Assoc &e) {
         return VoidV();
     }
 
+    chargeStep();
     Value result = es[first_non_define]->eval(new_env);//第一个
     //剩下的
     for (size_t i = first_non_define + 1; i < es.size(); i++) {
+        safepointPoll();
+        chargeStep();
         Value temp = es[i]->eval(new_env);
         result = temp;
     }
@@ -1242,6 +1412,7 @@ Value syntaxToValue(const Syntax &syntax) {
 }
 //#######
 Value Quote::eval(Assoc& e) {
+    if (__builtin_expect(expr_histogram, 0)) countEval(this);
     //TODO: To complete the quote logic
     return syntaxToValue(s);
 }
@@ -1256,6 +1427,7 @@ bool check_true(const Value &v) {
 }
 
 Value AndVar::eval(Assoc &e) { // and with short-circuit evaluation
+    if (__builtin_expect(expr_histogram, 0)) countEval(this);
     //TODO: To complete the and logic
     if (rands.empty()) {
         return BooleanV(true);
@@ -1272,6 +1444,7 @@ Value AndVar::eval(Assoc &e) { // and with short-circuit evaluation
 }
 
 Value OrVar::eval(Assoc &e) { // or with short-circuit evaluation
+    if (__builtin_expect(expr_histogram, 0)) countEval(this);
     //TODO: To complete the or logic
     if (rands.empty()) {
         return BooleanV(false);
@@ -1292,6 +1465,7 @@ Value Not::evalRator(const Value &rand) { // not
 }
 
 Value If::eval(Assoc &e) {
+    if (__builtin_expect(expr_histogram, 0)) countEval(this);
     //TODO: To complete the if logic
     Value result = cond->eval(e);
     if (check_true(result)) {
@@ -1302,6 +1476,7 @@ Value If::eval(Assoc &e) {
 }
 
 Value Cond::eval(Assoc &env) {
+    if (__builtin_expect(expr_histogram, 0)) countEval(this);
     //TODO: To complete the cond logic
     for (auto &clause : clauses) {
         if (clause.empty()) {
@@ -1355,45 +1530,68 @@ Value Cond::eval(Assoc &env) {
 }
 
 Value Lambda::eval(Assoc &env) {
+    if (__builtin_expect(expr_histogram, 0)) countEval(this);
     //TODO: To complete the lambda logic
     Assoc new_env = env;
-    return ProcedureV(x,e,new_env);//创建一个闭包，包括参数列表，函数体，定义时的环境
+    return ProcedureV(x,e,new_env,label);//创建一个闭包，包括参数列表，函数体，定义时的环境
 }
 
-Value Apply::eval(Assoc &e) {
+Value applyProcedure(const Value &proc_value, const std::vector<Value> &args) {
+    if (proc_value->v_type == V_PRIMITIVE) {//原生过程，直接调用 C++ 函数
+        Primitive* prim = static_cast<Primitive*>(proc_value.get());
+        if ((int)args.size() < prim->min_arity ||
+            (prim->max_arity >= 0 && (int)args.size() > prim->max_arity)) {
+            throw RuntimeError("Wrong number of arguments");
+        }
+        return prim->fn(args);
+    }
+    if (proc_value->v_type != V_PROC) {//不是函数类型
+        throw RuntimeError("Attempt to apply a non-procedure");
+    }
 
-    Value proc_value = rator->eval(e);
-     if (proc_value->v_type != V_PROC) {//不是函数类型
-         throw RuntimeError("Attempt to apply a non-procedure");
-     }
+    Procedure* clos_ptr = static_cast<Procedure*>(proc_value.get());//把基类指针 ValueBase* 转换为具体的 Procedure*
+    if (args.size() != clos_ptr->parameters.size()) throw RuntimeError("Wrong number of arguments");
 
-     //TODO: TO COMPLETE THE CLOSURE LOGIC
-     Procedure* clos_ptr = dynamic_cast<Procedure*>(proc_value.get());//把基类指针 ValueBase* 转换为具体的 Procedure*
+    //创建临时环境（只在函数调用期间存在，返回时自动销毁）
+    Assoc param_env = clos_ptr->env;
+    for (size_t i = 0; i < clos_ptr->parameters.size(); i++) {
+        param_env = extend(clos_ptr->parameters[i], args[i], param_env);
+    }
 
-     //TODO: TO COMPLETE THE ARGUMENT PARSER LOGIC
-     std::vector<Value> args;
-     for (auto &arg_expr : rand) {
-         args.push_back(arg_expr->eval(e));
-     }
-     // if (auto varNode = dynamic_cast<Variadic*>(clos_ptr->e.get())) {
-     //     //TODO
-     //
-     // }
-     if (args.size() != clos_ptr->parameters.size()) throw RuntimeError("Wrong number of arguments");
+    if (__builtin_expect(tracing, 0))
+        return tracedCall(clos_ptr, param_env);
+    if (__builtin_expect(profilingEnabled(), 0))
+        return profiledCall(clos_ptr, param_env);
+    return clos_ptr->e->eval(param_env);
+}
 
-     //TODO: TO COMPLETE THE PARAMETERS' ENVIRONMENT LOGIC
-     //创建临时环境（只在函数调用期间存在，返回时自动销毁）
-     Assoc param_env = clos_ptr->env;
-     for (size_t i = 0; i < clos_ptr->parameters.size(); i++) {
-         param_env = extend(clos_ptr->parameters[i],args[i], param_env);
-     }
+Value Apply::eval(Assoc &e) {
+    if (__builtin_expect(expr_histogram, 0)) countEval(this);
 
-     return clos_ptr->e->eval(param_env);
+    Value proc_value = rator->eval(e);
+    if (proc_value->v_type != V_PROC && proc_value->v_type != V_PRIMITIVE) {//不是函数类型
+        throw RuntimeError("Attempt to apply a non-procedure");
+    }
 
+    safepointPoll();
+    chargeStep();
+    std::vector<Value> args;
+    if (parallelArgsEnabled() && !plan.sequential.load(std::memory_order_relaxed) &&
+        evalArgsInParallel(plan, rand.data(), rand.size(), e, args)) {
+        DepthGuard depth;
+        return applyProcedure(proc_value, args);
+    }
+    args.reserve(rand.size());
+    for (auto &arg_expr : rand) {
+        args.push_back(arg_expr->eval(e));
+    }
+    DepthGuard depth;
+    return applyProcedure(proc_value, args);
 }
 
 
 Value Define::eval(Assoc &env) {
+    if (__builtin_expect(expr_histogram, 0)) countEval(this);
     //TODO: To complete the define logic
     if (primitives.count(var) || reserved_words.count(var)) {
         throw RuntimeError("Undefined variable");
@@ -1426,6 +1624,7 @@ Value Define::eval(Assoc &env) {
 
 
 Value Let::eval(Assoc &env) {
+    if (__builtin_expect(expr_histogram, 0)) countEval(this);
 
 
     // 求值所有绑定
@@ -1454,6 +1653,8 @@ Value Let::eval(Assoc &env) {
     }
 
 
+    if (__builtin_expect(samplingEnabled(), 0))
+        return sampledScope(label, body, new_env);
     Value result = body->eval(new_env);
 
     return result;
@@ -1497,6 +1698,7 @@ Value Let::eval(Assoc &env) {
 //     return body->eval(new_env);
 // }
 Value Letrec::eval(Assoc &env) {
+    if (__builtin_expect(expr_histogram, 0)) countEval(this);
     // 第一步：创建包含占位符的环境
     Assoc env1 = env;
     for (auto &binding : bind) {
@@ -1517,10 +1719,13 @@ Value Letrec::eval(Assoc &env) {
     }
 
     // 第四步：在更新后的环境中执行 body
+    if (__builtin_expect(samplingEnabled(), 0))
+        return sampledScope(label, body, env1);
     return body->eval(env1);  // 使用 env1，不是 new_env
 }
 
 Value Set::eval(Assoc &env) {//修改当前环境中找到的第一个该变量
+    if (__builtin_expect(expr_histogram, 0)) countEval(this);
     //TODO: To complete the set logic
     // struct Set : ExprBase {
     //     std::string var;  // 要修改的变量名
@@ -1542,10 +1747,63 @@ Value Set::eval(Assoc &env) {//修改当前环境中找到的第一个该变量
 Value Display::evalRator(const Value &rand) { // display function
     if (rand->v_type == V_STRING) {
         String* str_ptr = dynamic_cast<String*>(rand.get());
-        std::cout << str_ptr->s;
+        outputStream() << str_ptr->s;
     } else {
-        rand->show(std::cout);
+        rand->show(outputStream());
     }
 
     return VoidV();
 }
+
+Value SaveImage::eval(Assoc &e) { // save-image special form
+    if (__builtin_expect(expr_histogram, 0)) countEval(this);
+    Value path = file->eval(e);
+    if (path->v_type != V_STRING) {
+        throw RuntimeError("save-image: expected a file name string");
+    }
+    saveImage(static_cast<String*>(path.get())->s, e);
+    return VoidV();
+}
+
+static double processCpuMs() {
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+Value Time::eval(Assoc &env) { // time special form
+    if (__builtin_expect(expr_histogram, 0)) countEval(this);
+    Budget &b = eval_budget;
+    unsigned long applications = b.applications;
+    unsigned long depth = b.depth;
+    unsigned long outer_peak = b.peak_depth;
+    unsigned long values = threadAllocatedObjects(0, ALLOC_FRAME);
+    unsigned long frames = threadAllocatedObjects(ALLOC_FRAME, ALLOC_KINDS);
+    unsigned long bytes = threadAllocatedBytes();
+    b.peak_depth = depth;
+    double cpu_start = processCpuMs();
+    auto wall_start = std::chrono::steady_clock::now();
+
+    Value result(nullptr);
+    try {
+        result = e->eval(env);
+    } catch (...) {
+        // 外层 time 仍需看到内部达到的最大深度
+        if (outer_peak > b.peak_depth) b.peak_depth = outer_peak;
+        throw;
+    }
+
+    double wall = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wall_start).count();
+    double cpu = processCpuMs() - cpu_start;
+    unsigned long peak = b.peak_depth - depth;
+    if (outer_peak > b.peak_depth) b.peak_depth = outer_peak;
+
+    char line[256];
+    snprintf(line, sizeof(line),
+             "time: %.3f ms wall, %.3f ms cpu, %lu applications, %lu values, %lu environment frames, "
+             "%lu bytes, peak depth %lu\n",
+             wall, cpu, b.applications - applications, threadAllocatedObjects(0, ALLOC_FRAME) - values,
+             threadAllocatedObjects(ALLOC_FRAME, ALLOC_KINDS) - frames, threadAllocatedBytes() - bytes, peak);
+    outputStream() << line;
+    return result;
+}
@@ -17,7 +17,9 @@ int gcd(int a, int b) {
     return a;
 }
 
-ExprBase::ExprBase(ExprType et) : e_type(et) {}
+thread_local int parse_line = 0;
+
+ExprBase::ExprBase(ExprType et) : e_type(et), line(parse_line) {}
 
 Expr::Expr(ExprBase * eb) : ptr(eb) {}
 ExprBase* Expr::operator->() const { return ptr.get(); }
@@ -163,15 +165,18 @@ Var::Var(const string &s) : ExprBase(E_VAR), x(s) {}
 
 Apply::Apply(const Expr &expr, const vector<Expr> &vec) : ExprBase(E_APPLY), rator(expr), rand(vec) {}
 
-Lambda::Lambda(const vector<string> &vec, const Expr &expr) : ExprBase(E_LAMBDA), x(vec), e(expr) {}
+Lambda::Lambda(const vector<string> &vec, const Expr &expr, const std::string *label)
+    : ExprBase(E_LAMBDA), x(vec), e(expr), label(label) {}
 
 Define::Define(const string &variable, const Expr &expr) : ExprBase(E_DEFINE), var(variable), e(expr) {}
 
 //BINDING CONSTRUCTS
 
-Let::Let(const vector<pair<string, Expr>> &vec, const Expr &e) : ExprBase(E_LET), bind(vec), body(e) {}
+Let::Let(const vector<pair<string, Expr>> &vec, const Expr &e, const std::string *label)
+    : ExprBase(E_LET), bind(vec), body(e), label(label) {}
 
-Letrec::Letrec(const vector<pair<string, Expr>> &vec, const Expr &expr) : ExprBase(E_LETREC), bind(vec), body(expr) {}
+Letrec::Letrec(const vector<pair<string, Expr>> &vec, const Expr &expr, const std::string *label)
+    : ExprBase(E_LETREC), bind(vec), body(expr), label(label) {}
 
 //ASSIGNMENT
 
@@ -179,4 +184,14 @@ Set::Set(const std::string &var, const Expr &e) : ExprBase(E_SET), var(var), e(e
 
 //I/O OPERATIONS
 
-Display::Display(const Expr &r) : Unary(E_DISPLAY, r) {}
\ No newline at end of file
+Display::Display(const Expr &r) : Unary(E_DISPLAY, r) {}
+
+//IMAGES
+
+SaveImage::SaveImage(const Expr &f) : ExprBase(E_SAVE_IMAGE), file(f) {}
+
+//PARALLELISM
+
+MakeFuture::MakeFuture(const Expr &e) : ExprBase(E_FUTURE), e(e) {}
+
+Time::Time(const Expr &e) : ExprBase(E_TIME), e(e) {}
\ No newline at end of file
@@ -19,12 +19,17 @@ public:
 
 #include "Def.hpp"
 #include "syntax.hpp"
+#include <atomic>
 #include <memory>
 #include <cstring>
 #include <vector>
 
+// Source line stamped on expression nodes as they are created (0 outside the parser)
+extern thread_local int parse_line;
+
 struct ExprBase{
     ExprType e_type;
+    int line;   // 所在表达式左括号的行号，0 表示未知
     ExprBase(ExprType);
     virtual Value eval(Assoc &) = 0;
     virtual ~ExprBase() = default;
@@ -39,6 +44,18 @@ public:
     ExprBase* get() const;
 };
 
+struct ArgPlan;
+
+/**
+ * @brief Call site's cached --parallel-args plan, built on first use (see purity.hpp)
+ */
+struct ArgPlanSlot {
+    std::atomic<ArgPlan *> plan;
+    std::atomic<bool> sequential;   ///< Set once the plan rules out parallel evaluation
+    ArgPlanSlot() : plan(nullptr), sequential(false) {}
+    ~ArgPlanSlot();
+};
+
 // ================================================================================
 //                             BASIC TYPES AND LITERALS
 // ================================================================================
@@ -114,6 +131,7 @@ struct Unary : ExprBase {
 struct Binary : ExprBase {
     Expr rand1;
     Expr rand2;
+    ArgPlanSlot plan;
     Binary(ExprType, const Expr &, const Expr &);
     virtual Value evalRator(const Value &, const Value &) = 0;
     virtual Value eval(Assoc &) override;
@@ -121,6 +139,7 @@ struct Binary : ExprBase {
 
 struct Variadic : ExprBase {
     std::vector<Expr> rands;
+    ArgPlanSlot plan;
     Variadic(ExprType, const std::vector<Expr> &);
     virtual Value evalRator(const std::vector<Value> &) = 0;
     virtual Value eval(Assoc &) override;
@@ -385,6 +404,7 @@ struct Var : ExprBase {
 struct Apply : ExprBase {
     Expr rator;
     std::vector<Expr> rand;
+    ArgPlanSlot plan;
     Apply(const Expr &, const std::vector<Expr> &);
     virtual Value eval(Assoc &) override;
 };
@@ -392,7 +412,8 @@ struct Apply : ExprBase {
 struct Lambda : ExprBase {
     std::vector<std::string> x;
     Expr e;
-    Lambda(const std::vector<std::string> &, const Expr &);
+    const std::string *label;   ///< Profiler name, interned (see profile.hpp), nullptr if unnamed
+    Lambda(const std::vector<std::string> &, const Expr &, const std::string *label = nullptr);
     virtual Value eval(Assoc &) override;
 };
 
@@ -410,14 +431,16 @@ struct Define : ExprBase {
 struct Let : ExprBase {
     std::vector<std::pair<std::string, Expr>> bind;
     Expr body;
-    Let(const std::vector<std::pair<std::string, Expr>> &, const Expr &);
+    const std::string *label;   ///< Sampler name of the scope, interned (see profile.hpp)
+    Let(const std::vector<std::pair<std::string, Expr>> &, const Expr &, const std::string *label = nullptr);
     virtual Value eval(Assoc &) override;
 };
 
 struct Letrec : ExprBase {
     std::vector<std::pair<std::string, Expr>> bind;
     Expr body;
-    Letrec(const std::vector<std::pair<std::string, Expr>> &, const Expr &);
+    const std::string *label;   ///< Sampler name of the scope, interned (see profile.hpp)
+    Letrec(const std::vector<std::pair<std::string, Expr>> &, const Expr &, const std::string *label = nullptr);
     virtual Value eval(Assoc &) override;
 };
 
@@ -441,4 +464,42 @@ struct Display : Unary {
     virtual Value evalRator(const Value &) override;
 };
 
+// ================================================================================
+//                              PARALLELISM
+// ================================================================================
+
+struct MakeFuture : ExprBase {
+    Expr e;
+    MakeFuture(const Expr &);
+    virtual Value eval(Assoc &) override;
+};
+
+// ================================================================================
+//                              IMAGES
+// ================================================================================
+
+struct SaveImage : ExprBase {
+    Expr file;
+    SaveImage(const Expr &);
+    virtual Value eval(Assoc &) override;
+};
+
+// ================================================================================
+//                              DIAGNOSTICS
+// ================================================================================
+
+/**
+ * @brief (time body ...): evaluates the body once and prints what it cost
+ *
+ * Prints wall and process CPU time, and for the evaluating thread the
+ * procedure applications, values and environment frames allocated (with
+ * their bytes) and the deepest nesting reached below the form, then
+ * returns the value of the body.
+ */
+struct Time : ExprBase {
+    Expr e;
+    Time(const Expr &);
+    virtual Value eval(Assoc &) override;
+};
+
 #endif
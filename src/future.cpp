@@ -0,0 +1,86 @@
+/**
+ * @file future.cpp
+ * @brief Implementation of future and touch
+ */
+
+#include "future.hpp"
+#include "scheduler.hpp"
+#include "expr.hpp"
+#include "histogram.hpp"
+#include "RE.hpp"
+#include "io.hpp"
+#include "green.hpp"
+#include <sstream>
+
+namespace {
+
+struct FutureTask : Scheduler::Task {
+    std::shared_ptr<FutureState> state;
+    explicit FutureTask(const std::shared_ptr<FutureState> &state) : state(state) {}
+    virtual void run() override { state->run(); }
+};
+
+} // namespace
+
+FutureState::FutureState(const Expr &expr, const Assoc &env)
+    : expr(expr), env(env), origin(activeOverlay()), overlay(origin ? copyOverlay(*origin) : nullptr),
+      merged(false), budget(currentBudget()), status(PENDING), output_taken(false), result(nullptr), failed(false) {}
+
+void FutureState::run() {
+    int expected = PENDING;
+    if (!status.compare_exchange_strong(expected, RUNNING))
+        return;
+
+    BudgetScope scope(budget);
+    std::ostringstream buffer;
+    std::ostream *saved_output = &outputStream();
+    std::shared_ptr<EnvOverlay> saved_overlay = activeOverlay();
+    setOutputStream(&buffer);
+    setActiveOverlay(overlay);
+    try {
+        result = expr->eval(env);
+        greenRunAll();
+    } catch (const RuntimeError &err) {
+        failed = true;
+        error = err.message();
+    } catch (const std::exception &err) {
+        // 其他异常不能离开工作线程，否则进程终止
+        failed = true;
+        error = err.what();
+    } catch (...) {
+        failed = true;
+        error = "future: unknown error";
+    }
+    setOutputStream(saved_output);
+    setActiveOverlay(saved_overlay);
+    output = buffer.str();
+    status.store(DONE);
+}
+
+Value MakeFuture::eval(Assoc &env) {
+    if (__builtin_expect(expr_histogram, 0)) countEval(this);
+    std::shared_ptr<FutureState> state = std::make_shared<FutureState>(e, env);
+    Scheduler::instance().spawn(std::make_shared<FutureTask>(state));
+    return FutureV(state);
+}
+
+Value touchPrimitive(const std::vector<Value> &args) {
+    if (args[0]->v_type != V_FUTURE) {
+        return args[0];
+    }
+    FutureState &state = *static_cast<Future*>(args[0].get())->state;
+    // 还没有线程认领时直接在当前线程上求值，否则一边等待一边执行别的任务
+    state.run();
+    Scheduler::instance().helpUntil([&]() { return state.status.load() == FutureState::DONE; });
+    if (!state.output_taken.exchange(true)) {
+        outputStream() << state.output;
+    }
+    // 只有创建者所在的会话拥有 origin，在别处 touch 时不能写它
+    if (state.origin && state.origin == activeOverlay() && !state.merged.exchange(true)) {
+        mergeOverlay(*state.origin, *state.overlay);
+    }
+    if (state.failed) {
+        throw RuntimeError(state.error);
+    }
+    return state.result;
+}
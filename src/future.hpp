@@ -0,0 +1,57 @@
+#ifndef FUTURE_HPP
+#define FUTURE_HPP
+
+/**
+ * @file future.hpp
+ * @brief Fork-join futures on the work-stealing scheduler
+ *
+ * (future expr) captures expr with the current environment and queues it
+ * on the scheduler, returning a placeholder at once. (touch f) returns the
+ * value: if no thread has started the future yet it is evaluated inline on
+ * the touching thread, otherwise the toucher runs other queued tasks until
+ * it is done. Touching any other value returns it unchanged.
+ *
+ * A closure only holds its parameter list, body and captured environment,
+ * none of which change after Lambda::eval, and values are reference
+ * counted atomically, so closures can be shared freely between futures.
+ * In a forked session (--worker, --jobs) a future runs on its own copy of
+ * the session's overlay (see value.hpp), taken when it is created; the
+ * snapshot bindings it sets are merged into the session's overlay by the
+ * first touch made from that session. Other bindings are not locked:
+ * futures must not set! a variable created by the session or a plain
+ * interpreter that another running future or the parent reads. A future
+ * keeps its bindings view alive, so it may outlive the session that
+ * created it.
+ * Output of a future is buffered and written by its first touch; an error
+ * is rethrown as a RuntimeError by every touch.
+ */
+
+#include "value.hpp"
+#include "limits.hpp"
+#include <atomic>
+#include <string>
+#include <vector>
+
+struct FutureState {
+    enum Status { PENDING, RUNNING, DONE };
+
+    Expr expr;
+    Assoc env;
+    std::shared_ptr<EnvOverlay> origin;     ///< Bindings view of the thread that created the future
+    std::shared_ptr<EnvOverlay> overlay;    ///< Private copy of origin the future runs on
+    std::atomic<bool> merged;               ///< Writes to overlay applied to origin
+    std::shared_ptr<RequestBudget> budget;  ///< Quotas of the evaluation that created the future
+    std::atomic<int> status;
+    std::atomic<bool> output_taken;
+    Value result;
+    bool failed;
+    std::string error;
+    std::string output;
+
+    FutureState(const Expr &, const Assoc &);
+    void run();                     ///< Evaluates the expression unless another thread already claimed it
+};
+
+Value touchPrimitive(const std::vector<Value> &args);
+
+#endif // FUTURE_HPP
@@ -0,0 +1,308 @@
+/**
+ * @file green.cpp
+ * @brief Implementation of green threads and channels on ucontext
+ */
+
+#include "green.hpp"
+#include "RE.hpp"
+#include "io.hpp"
+#include "profile.hpp"
+#include "allocation.hpp"
+#include "limits.hpp"
+#include <deque>
+#include <algorithm>
+#include <atomic>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+// Reserved lazily: only the pages a thread actually touches are committed.
+// As large as the usual main thread stack, so recursion that works outside
+// a green thread also works inside one
+static const size_t GREEN_STACK_SIZE = 8 * 1024 * 1024;
+
+struct GreenThread {
+    ucontext_t context;
+    void *stack;
+    size_t mapped;
+    std::function<void()> body;
+    std::deque<GreenThread *> *waiting_on;   ///< Channel queue the thread is parked in
+    bool deadlocked;                         ///< Woken only to report a deadlock
+
+    // Evaluator state of the thread while it is switched out
+    std::ostream *output;
+    std::shared_ptr<EnvOverlay> overlay;
+    ProfileFrame *frames;
+    unsigned long depth;
+    unsigned long peak_depth;
+    unsigned long applications;
+
+    GreenThread()
+        : stack(nullptr), mapped(0), waiting_on(nullptr), deadlocked(false), output(nullptr), frames(nullptr),
+          depth(0), peak_depth(0), applications(0) {}
+    ~GreenThread() {
+        if (stack != nullptr) munmap(stack, mapped);
+    }
+};
+
+namespace {
+
+/**
+ * @brief Run queue of one OS thread
+ */
+struct GreenLoop {
+    GreenThread root;                        ///< The OS thread's own context
+    GreenThread *current;
+    std::deque<GreenThread *> runnable;
+    std::vector<GreenThread *> threads;      ///< Every spawned thread not yet freed
+    GreenThread *zombie;                     ///< Finished thread whose stack is freed after switching away
+    unsigned long id;                        ///< Never reused, unlike the address of a freed loop
+    GreenLoop() : current(&root), zombie(nullptr), id(next_id.fetch_add(1) + 1) {}
+    static std::atomic<unsigned long> next_id;
+    ~GreenLoop() {
+        // 仍停在通道上的线程不会再运行；栈上对象的析构无法执行，只释放栈本身
+        for (GreenThread *t : threads) delete t;
+    }
+};
+
+std::atomic<unsigned long> GreenLoop::next_id(0);
+
+thread_local GreenLoop *green_loop = nullptr;
+
+// Frees the loop of an OS thread when it exits
+struct LoopOwner {
+    ~LoopOwner() {
+        delete green_loop;
+        green_loop = nullptr;
+    }
+};
+
+GreenLoop &loop() {
+    if (green_loop == nullptr) {
+        green_loop = new GreenLoop();
+        static thread_local LoopOwner owner;
+        (void)owner;
+    }
+    return *green_loop;
+}
+
+void reap(GreenLoop &l) {
+    if (l.zombie != nullptr && l.zombie != l.current) {
+        l.threads.erase(std::remove(l.threads.begin(), l.threads.end(), l.zombie), l.threads.end());
+        delete l.zombie;
+        l.zombie = nullptr;
+    }
+}
+
+void saveState(GreenThread *t) {
+    Budget &b = eval_budget;
+    t->output = &outputStream();
+    t->overlay = activeOverlay();
+    t->frames = profileTop();
+    t->depth = b.depth;
+    t->peak_depth = b.peak_depth;
+    t->applications = b.applications;
+}
+
+void restoreState(GreenThread *t) {
+    Budget &b = eval_budget;
+    setOutputStream(t->output);
+    setActiveOverlay(t->overlay);
+    setProfileTop(t->frames);
+    b.depth = t->depth;
+    b.peak_depth = t->peak_depth;
+    b.applications = t->applications;
+}
+
+void switchTo(GreenLoop &l, GreenThread *next) {
+    GreenThread *prev = l.current;
+    l.current = next;
+    // 每个上下文有自己的输出流、绑定视图、profiler 帧链与调用深度
+    saveState(prev);
+    swapcontext(&prev->context, &next->context);
+    restoreState(prev);
+    reap(l);
+}
+
+// Makes the original context runnable again so its blocked operation can fail
+void abortRoot(GreenLoop &l) {
+    GreenThread *root = &l.root;
+    if (root->waiting_on != nullptr) {
+        std::deque<GreenThread *> &q = *root->waiting_on;
+        q.erase(std::remove(q.begin(), q.end(), root), q.end());
+        root->waiting_on = nullptr;
+    }
+    root->deadlocked = true;
+    l.runnable.push_back(root);
+}
+
+void entry() {
+    GreenLoop &l = loop();
+    GreenThread *self = l.current;
+    restoreState(self);
+    reap(l);
+    try {
+        self->body();
+    } catch (...) {
+        // 与 REPL 一致：出错的绿色线程报告 RuntimeError 后结束；
+        // 任何异常都不能越过上下文入口
+        outputStream() << "RuntimeError\n";
+    }
+    self->body = std::function<void()>();
+    self->overlay.reset();
+    l.zombie = self;
+    // 所有剩余线程都已阻塞时，原始上下文必然在等待，唤醒它报告死锁
+    if (l.runnable.empty()) abortRoot(l);
+    GreenThread *next = l.runnable.front();
+    l.runnable.pop_front();
+    l.current = next;
+    setcontext(&next->context);
+}
+
+void park(std::deque<GreenThread *> &waiters) {
+    GreenLoop &l = loop();
+    GreenThread *self = l.current;
+    if (l.runnable.empty()) {
+        if (self == &l.root) throw RuntimeError("Deadlock: every green thread is blocked");
+        abortRoot(l);
+    }
+    waiters.push_back(self);
+    self->waiting_on = &waiters;
+    GreenThread *next = l.runnable.front();
+    l.runnable.pop_front();
+    switchTo(l, next);
+    if (self->deadlocked) {
+        self->deadlocked = false;
+        throw RuntimeError("Deadlock: every green thread is blocked");
+    }
+}
+
+void wakeOne(std::deque<GreenThread *> &waiters) {
+    if (waiters.empty()) return;
+    GreenThread *t = waiters.front();
+    waiters.pop_front();
+    t->waiting_on = nullptr;
+    loop().runnable.push_back(t);
+}
+
+} // namespace
+
+/**
+ * @brief Bounded FIFO with the green threads parked on it
+ */
+struct ChannelState {
+    size_t capacity;
+    std::deque<Value> items;
+    std::deque<GreenThread *> getters;
+    std::deque<GreenThread *> putters;
+    unsigned long owner;                     ///< Id of the loop of the OS thread that made it
+    ChannelState(size_t capacity, unsigned long owner) : capacity(capacity), owner(owner) {}
+};
+
+void greenSpawn(const std::function<void()> &body) {
+    GreenLoop &l = loop();
+    long page = sysconf(_SC_PAGESIZE);
+    GreenThread *t = new GreenThread();
+    t->mapped = GREEN_STACK_SIZE + page;
+    t->stack = mmap(nullptr, t->mapped, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (t->stack == MAP_FAILED) {
+        t->stack = nullptr;
+        delete t;
+        throw RuntimeError("spawn: cannot allocate a stack");
+    }
+    mprotect(t->stack, page, PROT_NONE);   // 栈溢出时触发段错误而不是覆盖相邻内存
+    t->body = body;
+    t->output = &outputStream();
+    t->overlay = activeOverlay();
+    getcontext(&t->context);
+    t->context.uc_stack.ss_sp = static_cast<char *>(t->stack) + page;
+    t->context.uc_stack.ss_size = GREEN_STACK_SIZE;
+    t->context.uc_link = nullptr;
+    makecontext(&t->context, entry, 0);
+    l.threads.push_back(t);
+    l.runnable.push_back(t);
+}
+
+void greenYield() {
+    GreenLoop &l = loop();
+    if (l.runnable.empty()) return;
+    GreenThread *next = l.runnable.front();
+    l.runnable.pop_front();
+    l.runnable.push_back(l.current);
+    switchTo(l, next);
+}
+
+void greenRunAll() {
+    if (green_loop == nullptr) return;
+    GreenLoop &l = *green_loop;
+    if (l.current != &l.root) return;
+    while (!l.runnable.empty()) greenYield();
+}
+
+Channel::Channel(const std::shared_ptr<ChannelState> &state) : ValueBase(V_CHANNEL), state(state) {}
+
+void Channel::show(std::ostream &os) {
+    os << "#<channel>";
+}
+
+static ChannelState &channelArg(const Value &v, const char *who) {
+    if (v->v_type != V_CHANNEL) {
+        throw RuntimeError(std::string(who) + ": expected a channel");
+    }
+    ChannelState &ch = *static_cast<Channel*>(v.get())->state;
+    // 停在通道上的线程属于创建者的运行队列，别的 OS 线程不能切换进去
+    if (ch.owner != loop().id) {
+        throw RuntimeError(std::string(who) + ": channel belongs to another thread");
+    }
+    return ch;
+}
+
+Value spawnPrimitive(const std::vector<Value> &args) {
+    Value proc = args[0];
+    if (proc->v_type != V_PROC && proc->v_type != V_PRIMITIVE) {
+        throw RuntimeError("spawn: expected a procedure");
+    }
+    std::vector<Value> rest(args.begin() + 1, args.end());
+    greenSpawn([proc, rest]() { applyProcedure(proc, rest); });
+    return VoidV();
+}
+
+Value yieldPrimitive(const std::vector<Value> &args) {
+    (void)args;
+    greenYield();
+    return VoidV();
+}
+
+Value makeChannelPrimitive(const std::vector<Value> &args) {
+    int capacity = 1;
+    if (!args.empty()) {
+        if (args[0]->v_type != V_INT || static_cast<Integer*>(args[0].get())->n < 1) {
+            throw RuntimeError("make-channel: capacity must be a positive integer");
+        }
+        capacity = static_cast<Integer*>(args[0].get())->n;
+    }
+    countAllocation(V_CHANNEL, sizeof(Channel));
+    return Value(new Channel(std::make_shared<ChannelState>(capacity, loop().id)));
+}
+
+Value channelPutPrimitive(const std::vector<Value> &args) {
+    ChannelState &ch = channelArg(args[0], "channel-put!");
+    while (ch.items.size() >= ch.capacity) {
+        park(ch.putters);
+    }
+    ch.items.push_back(args[1]);
+    wakeOne(ch.getters);
+    return VoidV();
+}
+
+Value channelGetPrimitive(const std::vector<Value> &args) {
+    ChannelState &ch = channelArg(args[0], "channel-get");
+    while (ch.items.empty()) {
+        park(ch.getters);
+    }
+    Value v = ch.items.front();
+    ch.items.pop_front();
+    wakeOne(ch.putters);
+    return v;
+}
@@ -0,0 +1,67 @@
+#ifndef GREEN_HPP
+#define GREEN_HPP
+
+/**
+ * @file green.hpp
+ * @brief Green threads and bounded channels
+ *
+ * Green threads are multiplexed M:1 onto the OS thread that spawned them;
+ * every OS thread (main, --jobs workers, scheduler threads) keeps its own
+ * run queue, and green threads never migrate. Each one runs on a private
+ * stack, so the evaluator's C++ recursion is simply suspended in place by
+ * a context switch. Scheduling is cooperative: a green thread runs until
+ * it yields, blocks on a channel or returns. The code that spawned the
+ * first green thread takes part like any other.
+ *
+ * Before a top-level form, Interpreter::eval or call, future or parallel
+ * range returns, it runs the green threads of its OS thread until none is
+ * runnable. Threads still parked on a channel stay parked until a later
+ * form wakes them, and are freed with their OS thread.
+ *
+ * A green thread starts with the output stream and bindings view of its
+ * spawner, and has its own depth and application count (see limits.hpp).
+ * Steps, heap and time count against the evaluation running on the OS
+ * thread.
+ *
+ *   (spawn proc arg ...)       runs (proc arg ...) in a new green thread
+ *   (yield)                    moves the current thread to the back of the queue
+ *   (make-channel [capacity])  bounded FIFO channel, capacity 1 by default
+ *   (channel-put! ch v)        parks while the channel is full
+ *   (channel-get ch)           parks while the channel is empty
+ *
+ * Blocking parks the green thread until the matching operation wakes it.
+ * If every green thread of an OS thread is parked, the blocked operation
+ * of the original thread fails with a deadlock RuntimeError. A channel
+ * belongs to the OS thread that made it; using it from another one, e.g.
+ * inside a future or parallel-map task, is a RuntimeError.
+ */
+
+#include "value.hpp"
+#include <functional>
+#include <vector>
+
+// C++ interface, also used by the primitives
+void greenSpawn(const std::function<void()> &body);
+void greenYield();
+
+// Runs the green threads of this OS thread until none is runnable; no-op inside a green thread
+void greenRunAll();
+
+struct ChannelState;
+
+/**
+ * @brief Channel value returned by make-channel
+ */
+struct Channel : ValueBase {
+    std::shared_ptr<ChannelState> state;
+    Channel(const std::shared_ptr<ChannelState> &);
+    virtual void show(std::ostream &) override;
+};
+
+Value spawnPrimitive(const std::vector<Value> &args);
+Value yieldPrimitive(const std::vector<Value> &args);
+Value makeChannelPrimitive(const std::vector<Value> &args);
+Value channelPutPrimitive(const std::vector<Value> &args);
+Value channelGetPrimitive(const std::vector<Value> &args);
+
+#endif // GREEN_HPP
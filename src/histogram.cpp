@@ -0,0 +1,237 @@
+/**
+ * @file histogram.cpp
+ * @brief Implementation of the expression execution histogram
+ */
+
+#include "histogram.hpp"
+#include "allocation.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+bool expr_histogram = false;
+
+extern const std::map<std::string, ExprType> primitives;
+extern const std::map<std::string, ExprType> reserved_words;
+
+namespace {
+
+std::string output_path;
+
+struct NodeKey {
+    const ExprBase *node;
+    int type;
+    int line;
+    bool operator==(const NodeKey &o) const {
+        return node == o.node && type == o.type && line == o.line;
+    }
+};
+
+struct NodeKeyHash {
+    size_t operator()(const NodeKey &k) const {
+        return std::hash<const void *>()(k.node) ^ ((size_t)k.type << 20) ^ (size_t)k.line;
+    }
+};
+
+struct NodeCounts {
+    unsigned long count;
+    std::map<std::pair<int, int>, unsigned long> operands;  ///< (left, right) value types
+    NodeCounts() : count(0) {}
+};
+
+typedef std::unordered_map<NodeKey, NodeCounts, NodeKeyHash> NodeTable;
+
+/**
+ * @brief Table of one thread; the lock is only contended while the report is written
+ */
+struct ThreadTable {
+    std::mutex lock;
+    NodeTable nodes;
+};
+
+struct Registry {
+    std::mutex lock;
+    std::vector<ThreadTable *> live;
+    NodeTable retired;
+};
+
+Registry &registry() {
+    static Registry *instance = new Registry();
+    return *instance;
+}
+
+void merge(NodeTable &into, const NodeTable &from) {
+    for (auto &item : from) {
+        NodeCounts &c = into[item.first];
+        c.count += item.second.count;
+        for (auto &pair : item.second.operands) c.operands[pair.first] += pair.second;
+    }
+}
+
+thread_local ThreadTable *thread_table = nullptr;
+
+// Moves the thread's counts to the retired table when it exits
+struct Unregister {
+    ~Unregister() {
+        Registry &r = registry();
+        std::lock_guard<std::mutex> guard(r.lock);
+        merge(r.retired, thread_table->nodes);
+        r.live.erase(std::remove(r.live.begin(), r.live.end(), thread_table), r.live.end());
+        delete thread_table;
+        thread_table = nullptr;
+    }
+};
+
+ThreadTable &threadTable() {
+    if (thread_table == nullptr) {
+        thread_table = new ThreadTable();
+        {
+            Registry &r = registry();
+            std::lock_guard<std::mutex> guard(r.lock);
+            r.live.push_back(thread_table);
+        }
+        static thread_local Unregister unregister;
+        (void)unregister;
+    }
+    return *thread_table;
+}
+
+NodeCounts &counts(ThreadTable &t, const ExprBase *e) {
+    return t.nodes[NodeKey{e, e->e_type, e->line}];
+}
+
+std::string typeName(int type) {
+    switch (type) {
+        case E_FIXNUM:   return "fixnum";
+        case E_RATIONAL: return "rational";
+        case E_STRING:   return "string";
+        case E_TRUE:     return "#t";
+        case E_FALSE:    return "#f";
+        case E_VAR:      return "variable";
+        case E_APPLY:    return "apply";
+    }
+    for (auto &item : reserved_words)
+        if (item.second == type) return item.first;
+    for (auto &item : primitives)
+        if (item.second == type) return item.first;
+    return "expr-" + std::to_string(type);
+}
+
+struct NodeRow {
+    int type;
+    int line;
+    const NodeCounts *counts;
+};
+
+struct OperandRow {
+    int left;
+    int right;
+    unsigned long count;
+};
+
+std::vector<OperandRow> operandRows(const NodeCounts &c) {
+    std::vector<OperandRow> rows;
+    for (auto &pair : c.operands) rows.push_back({pair.first.first, pair.first.second, pair.second});
+    std::stable_sort(rows.begin(), rows.end(),
+                     [](const OperandRow &a, const OperandRow &b) { return a.count > b.count; });
+    return rows;
+}
+
+bool writeHistogram(const std::string &path, const NodeTable &table) {
+    std::map<int, unsigned long> by_type;
+    std::vector<NodeRow> nodes;
+    for (auto &item : table) {
+        by_type[item.first.type] += item.second.count;
+        nodes.push_back({item.first.type, item.first.line, &item.second});
+    }
+    std::vector<std::pair<int, unsigned long>> types(by_type.begin(), by_type.end());
+    std::stable_sort(types.begin(), types.end(),
+                     [](const std::pair<int, unsigned long> &a, const std::pair<int, unsigned long> &b) {
+                         return a.second > b.second;
+                     });
+    std::sort(nodes.begin(), nodes.end(), [](const NodeRow &a, const NodeRow &b) {
+        if (a.counts->count != b.counts->count) return a.counts->count > b.counts->count;
+        if (a.line != b.line) return a.line < b.line;
+        return a.type < b.type;
+    });
+
+    FILE *out = fopen(path.c_str(), "w");
+    if (out == nullptr) return false;
+    bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+    if (json) {
+        fprintf(out, "{\n  \"types\": [");
+        for (size_t i = 0; i < types.size(); i++) {
+            fprintf(out, "%s\n    {\"type\": \"%s\", \"count\": %lu}", i == 0 ? "" : ",",
+                    typeName(types[i].first).c_str(), types[i].second);
+        }
+        fprintf(out, "\n  ],\n  \"nodes\": [");
+        for (size_t i = 0; i < nodes.size(); i++) {
+            fprintf(out, "%s\n    {\"id\": %zu, \"type\": \"%s\", \"line\": %d, \"count\": %lu", i == 0 ? "" : ",",
+                    i + 1, typeName(nodes[i].type).c_str(), nodes[i].line, nodes[i].counts->count);
+            if (!nodes[i].counts->operands.empty()) {
+                fprintf(out, ", \"operands\": [");
+                std::vector<OperandRow> rows = operandRows(*nodes[i].counts);
+                for (size_t j = 0; j < rows.size(); j++) {
+                    fprintf(out, "%s{\"left\": \"%s\", \"right\": \"%s\", \"count\": %lu}", j == 0 ? "" : ", ",
+                            allocationKindName(rows[j].left), allocationKindName(rows[j].right), rows[j].count);
+                }
+                fprintf(out, "]");
+            }
+            fprintf(out, "}");
+        }
+        fprintf(out, "\n  ]\n}\n");
+    } else {
+        // 三部分共用一张表，section 列区分
+        fprintf(out, "section,id,type,line,left,right,count\n");
+        for (auto &t : types)
+            fprintf(out, "type,,%s,,,,%lu\n", typeName(t.first).c_str(), t.second);
+        for (size_t i = 0; i < nodes.size(); i++)
+            fprintf(out, "node,%zu,%s,%d,,,%lu\n", i + 1, typeName(nodes[i].type).c_str(), nodes[i].line,
+                    nodes[i].counts->count);
+        for (size_t i = 0; i < nodes.size(); i++) {
+            for (const OperandRow &row : operandRows(*nodes[i].counts)) {
+                fprintf(out, "operands,%zu,%s,%d,%s,%s,%lu\n", i + 1, typeName(nodes[i].type).c_str(),
+                        nodes[i].line, allocationKindName(row.left), allocationKindName(row.right), row.count);
+            }
+        }
+    }
+    return fclose(out) == 0;
+}
+
+} // namespace
+
+void enableExprHistogram(const std::string &path) {
+    output_path = path;
+    expr_histogram = true;
+}
+
+void countEval(const ExprBase *e) {
+    ThreadTable &t = threadTable();
+    std::lock_guard<std::mutex> guard(t.lock);
+    counts(t, e).count++;
+}
+
+void countOperands(const ExprBase *e, const Value &left, const Value &right) {
+    ThreadTable &t = threadTable();
+    std::lock_guard<std::mutex> guard(t.lock);
+    counts(t, e).operands[std::make_pair((int)left->v_type, (int)right->v_type)]++;
+}
+
+void writeExprHistogram(std::ostream &os) {
+    if (!expr_histogram) return;
+    NodeTable total;
+    {
+        Registry &r = registry();
+        std::lock_guard<std::mutex> guard(r.lock);
+        total = r.retired;
+        for (ThreadTable *t : r.live) {
+            std::lock_guard<std::mutex> table_guard(t->lock);
+            merge(total, t->nodes);
+        }
+    }
+    if (!writeHistogram(output_path, total))
+        os << "cannot write expression histogram to " << output_path << std::endl;
+}
@@ -0,0 +1,42 @@
+#ifndef HISTOGRAM_HPP
+#define HISTOGRAM_HPP
+
+/**
+ * @file histogram.hpp
+ * @brief Execution counts per expression type and per node (--expr-histogram)
+ *
+ * With --expr-histogram FILE every evaluation of an expression node is
+ * counted in a table of the evaluating thread, keyed by the node. Binary
+ * nodes (two-operand primitives such as +, < or cons) also count the
+ * pairs of operand types they see. At exit the tables of all threads are
+ * merged and written to FILE, as JSON if its name ends in ".json" and as
+ * CSV otherwise, each part sorted by count:
+ *
+ *   - evaluations per expression type
+ *   - evaluations per node, with the line of its form
+ *   - operand type pairs per Binary node, e.g. + at line 3: integer/integer
+ *
+ * Nodes are told apart by address, type and line, so a node freed and
+ * another created at the same address with the same type and line are
+ * counted together. Nodes loaded from an image have no line (0).
+ *
+ * When it is off each evaluation pays one predictable branch.
+ */
+
+#include "expr.hpp"
+#include "value.hpp"
+#include <ostream>
+#include <string>
+
+extern bool expr_histogram;
+
+// Starts counting; the histogram is written to path by writeExprHistogram
+void enableExprHistogram(const std::string &path);
+
+void countEval(const ExprBase *);
+void countOperands(const ExprBase *, const Value &, const Value &);
+
+// Writes the histogram if it is enabled; a file that cannot be written is reported on os
+void writeExprHistogram(std::ostream &os);
+
+#endif // HISTOGRAM_HPP
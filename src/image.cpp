@@ -0,0 +1,740 @@
+/**
+ * @file image.cpp
+ * @brief Implementation of heap image snapshot and restore
+ */
+
+#include "image.hpp"
+#include "expr.hpp"
+#include "syntax.hpp"
+#include "RE.hpp"
+#include "profile.hpp"
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char IMAGE_MAGIC[8] = {'S', 'C', 'M', 'I', 'M', 'G', '\0', '\1'};
+const uint32_t IMAGE_VERSION = 3;   // 2: profiler labels of lambdas, 3: of let and letrec
+const uint32_t NO_REF = 0xffffffffu;
+
+enum ImageTag {
+    // Code section
+    TAG_SYN_NUMBER,
+    TAG_SYN_RATIONAL,
+    TAG_SYN_TRUE,
+    TAG_SYN_FALSE,
+    TAG_SYN_SYMBOL,
+    TAG_SYN_STRING,
+    TAG_SYN_LIST,
+    TAG_EXPR,
+
+    // Heap section
+    TAG_INT,
+    TAG_RATIONAL,
+    TAG_BOOL,
+    TAG_SYM,
+    TAG_NULL,
+    TAG_STRING,
+    TAG_PAIR,
+    TAG_PROC,
+    TAG_PRIMITIVE,
+    TAG_VOID,
+    TAG_TERMINATE,
+    TAG_ENV
+};
+
+// Expression nodes sharing an ExprType come in a fixed-arity and a variadic form
+enum ExprShape {
+    SHAPE_FIXED,
+    SHAPE_VARIADIC
+};
+
+struct ImageHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t code_count;
+    uint32_t heap_count;
+    uint32_t root;
+};
+
+// ============================================================================
+// Writer
+// ============================================================================
+
+class ImageWriter {
+public:
+    ImageWriter() : code_count(0), heap_count(0) {}
+    std::string write(const Assoc &env);
+
+private:
+    uint32_t code(const Syntax &);
+    uint32_t code(const Expr &);
+    uint32_t heap(const void *);
+    void writeHeapObject(const void *, bool is_env);
+
+    static void putU8(std::string &out, uint8_t x) { out.push_back((char)x); }
+    static void putU32(std::string &out, uint32_t x) { out.append((const char *)&x, sizeof(x)); }
+    static void putI32(std::string &out, int32_t x) { out.append((const char *)&x, sizeof(x)); }
+    static void putStr(std::string &out, const std::string &s) {
+        putU32(out, (uint32_t)s.size());
+        out.append(s);
+    }
+
+    std::string code_out;
+    std::string heap_out;
+    uint32_t code_count;
+    uint32_t heap_count;
+    std::unordered_map<const void *, uint32_t> code_ids;
+    std::unordered_map<const void *, uint32_t> heap_ids;
+    std::vector<std::pair<const void *, bool>> heap_queue;   ///< Objects in index order, flag marks env nodes
+};
+
+uint32_t ImageWriter::code(const Syntax &stx) {
+    SyntaxBase *s = stx.get();
+    if (s == nullptr) return NO_REF;
+    auto it = code_ids.find(s);
+    if (it != code_ids.end()) return it->second;
+
+    std::string rec;
+    if (auto num = dynamic_cast<Number*>(s)) {
+        putU8(rec, TAG_SYN_NUMBER);
+        putI32(rec, num->n);
+    } else if (auto rat = dynamic_cast<RationalSyntax*>(s)) {
+        putU8(rec, TAG_SYN_RATIONAL);
+        putI32(rec, rat->numerator);
+        putI32(rec, rat->denominator);
+    } else if (dynamic_cast<TrueSyntax*>(s)) {
+        putU8(rec, TAG_SYN_TRUE);
+    } else if (dynamic_cast<FalseSyntax*>(s)) {
+        putU8(rec, TAG_SYN_FALSE);
+    } else if (auto sym = dynamic_cast<SymbolSyntax*>(s)) {
+        putU8(rec, TAG_SYN_SYMBOL);
+        putStr(rec, sym->s);
+    } else if (auto str = dynamic_cast<StringSyntax*>(s)) {
+        putU8(rec, TAG_SYN_STRING);
+        putStr(rec, str->s);
+    } else if (auto lst = dynamic_cast<List*>(s)) {
+        std::vector<uint32_t> items;
+        for (auto &item : lst->stxs) items.push_back(code(item));
+        putU8(rec, TAG_SYN_LIST);
+        putU32(rec, (uint32_t)items.size());
+        for (uint32_t ref : items) putU32(rec, ref);
+    } else {
+        throw RuntimeError("save-image: unsupported syntax node");
+    }
+    code_out.append(rec);
+    code_ids[s] = code_count;
+    return code_count++;
+}
+
+uint32_t ImageWriter::code(const Expr &expr) {
+    ExprBase *e = expr.get();
+    if (e == nullptr) return NO_REF;
+    auto it = code_ids.find(e);
+    if (it != code_ids.end()) return it->second;
+
+    // Children are written first so the loader can construct bottom-up
+    std::string rec;
+    putU8(rec, TAG_EXPR);
+    putU8(rec, (uint8_t)e->e_type);
+    if (auto un = dynamic_cast<Unary*>(e)) {
+        uint32_t a = code(un->rand);
+        putU8(rec, SHAPE_FIXED);
+        putU32(rec, a);
+    } else if (auto bin = dynamic_cast<Binary*>(e)) {
+        uint32_t a = code(bin->rand1);
+        uint32_t b = code(bin->rand2);
+        putU8(rec, SHAPE_FIXED);
+        putU32(rec, a);
+        putU32(rec, b);
+    } else {
+        std::vector<uint32_t> refs;
+        const std::vector<Expr> *list = nullptr;
+        if (auto var = dynamic_cast<Variadic*>(e)) list = &var->rands;
+        else if (auto a = dynamic_cast<AndVar*>(e)) list = &a->rands;
+        else if (auto o = dynamic_cast<OrVar*>(e)) list = &o->rands;
+        else if (auto b = dynamic_cast<Begin*>(e)) list = &b->es;
+
+        if (list != nullptr) {
+            for (auto &sub : *list) refs.push_back(code(sub));
+            putU8(rec, SHAPE_VARIADIC);
+            putU32(rec, (uint32_t)refs.size());
+            for (uint32_t ref : refs) putU32(rec, ref);
+        } else {
+            putU8(rec, SHAPE_FIXED);
+            switch (e->e_type) {
+                case E_FIXNUM:
+                    putI32(rec, static_cast<Fixnum*>(e)->n);
+                    break;
+                case E_RATIONAL:
+                    putI32(rec, static_cast<RationalNum*>(e)->numerator);
+                    putI32(rec, static_cast<RationalNum*>(e)->denominator);
+                    break;
+                case E_STRING:
+                    putStr(rec, static_cast<StringExpr*>(e)->s);
+                    break;
+                case E_TRUE:
+                case E_FALSE:
+                case E_VOID:
+                case E_EXIT:
+                    break;
+                case E_QUOTE:
+                    putU32(rec, code(static_cast<Quote*>(e)->s));
+                    break;
+                case E_IF: {
+                    If *node = static_cast<If*>(e);
+                    uint32_t c = code(node->cond), t = code(node->conseq), f = code(node->alter);
+                    putU32(rec, c);
+                    putU32(rec, t);
+                    putU32(rec, f);
+                    break;
+                }
+                case E_COND: {
+                    Cond *node = static_cast<Cond*>(e);
+                    std::vector<std::vector<uint32_t>> clauses;
+                    for (auto &clause : node->clauses) {
+                        std::vector<uint32_t> refs;
+                        for (auto &sub : clause) refs.push_back(code(sub));
+                        clauses.push_back(refs);
+                    }
+                    putU32(rec, (uint32_t)clauses.size());
+                    for (auto &clause : clauses) {
+                        putU32(rec, (uint32_t)clause.size());
+                        for (uint32_t ref : clause) putU32(rec, ref);
+                    }
+                    break;
+                }
+                case E_VAR:
+                    putStr(rec, static_cast<Var*>(e)->x);
+                    break;
+                case E_APPLY: {
+                    Apply *node = static_cast<Apply*>(e);
+                    uint32_t rator = code(node->rator);
+                    std::vector<uint32_t> rands;
+                    for (auto &sub : node->rand) rands.push_back(code(sub));
+                    putU32(rec, rator);
+                    putU32(rec, (uint32_t)rands.size());
+                    for (uint32_t ref : rands) putU32(rec, ref);
+                    break;
+                }
+                case E_LAMBDA: {
+                    Lambda *node = static_cast<Lambda*>(e);
+                    uint32_t body = code(node->e);
+                    putU32(rec, (uint32_t)node->x.size());
+                    for (auto &name : node->x) putStr(rec, name);
+                    putU32(rec, body);
+                    putStr(rec, node->label != nullptr ? *node->label : std::string());
+                    break;
+                }
+                case E_DEFINE:
+                case E_SET: {
+                    const std::string &var = e->e_type == E_DEFINE ? static_cast<Define*>(e)->var
+                                                                   : static_cast<Set*>(e)->var;
+                    const Expr &sub = e->e_type == E_DEFINE ? static_cast<Define*>(e)->e
+                                                            : static_cast<Set*>(e)->e;
+                    uint32_t ref = code(sub);
+                    putStr(rec, var);
+                    putU32(rec, ref);
+                    break;
+                }
+                case E_LET:
+                case E_LETREC: {
+                    const std::vector<std::pair<std::string, Expr>> &bind =
+                        e->e_type == E_LET ? static_cast<Let*>(e)->bind : static_cast<Letrec*>(e)->bind;
+                    const Expr &body = e->e_type == E_LET ? static_cast<Let*>(e)->body
+                                                          : static_cast<Letrec*>(e)->body;
+                    const std::string *label = e->e_type == E_LET ? static_cast<Let*>(e)->label
+                                                                  : static_cast<Letrec*>(e)->label;
+                    std::vector<uint32_t> refs;
+                    for (auto &b : bind) refs.push_back(code(b.second));
+                    uint32_t body_ref = code(body);
+                    putU32(rec, (uint32_t)bind.size());
+                    for (size_t i = 0; i < bind.size(); i++) {
+                        putStr(rec, bind[i].first);
+                        putU32(rec, refs[i]);
+                    }
+                    putU32(rec, body_ref);
+                    putStr(rec, label != nullptr ? *label : std::string());
+                    break;
+                }
+                case E_SAVE_IMAGE:
+                    putU32(rec, code(static_cast<SaveImage*>(e)->file));
+                    break;
+                case E_FUTURE:
+                    putU32(rec, code(static_cast<MakeFuture*>(e)->e));
+                    break;
+                case E_TIME:
+                    putU32(rec, code(static_cast<Time*>(e)->e));
+                    break;
+                default:
+                    throw RuntimeError("save-image: unsupported expression node");
+            }
+        }
+    }
+    code_out.append(rec);
+    code_ids[e] = code_count;
+    return code_count++;
+}
+
+uint32_t ImageWriter::heap(const void *obj) {
+    if (obj == nullptr) return NO_REF;
+    auto it = heap_ids.find(obj);
+    if (it != heap_ids.end()) return it->second;
+    heap_ids[obj] = heap_count;
+    return heap_count++;
+}
+
+void ImageWriter::writeHeapObject(const void *obj, bool is_env) {
+    std::string &rec = heap_out;
+    if (is_env) {
+        const AssocList *node = static_cast<const AssocList*>(obj);
+        putU8(rec, TAG_ENV);
+        putStr(rec, node->x);
+        uint32_t before = heap_count;
+        Value value = bindingValue(node);
+        uint32_t v = heap(value.get());
+        if (heap_count != before) heap_queue.push_back({value.get(), false});
+        before = heap_count;
+        uint32_t next = heap(node->next.get());
+        if (heap_count != before) heap_queue.push_back({node->next.get(), true});
+        putU32(rec, v);
+        putU32(rec, next);
+        return;
+    }
+
+    const ValueBase *v = static_cast<const ValueBase*>(obj);
+    switch (v->v_type) {
+        case V_INT:
+            putU8(rec, TAG_INT);
+            putI32(rec, static_cast<const Integer*>(v)->n);
+            break;
+        case V_RATIONAL:
+            putU8(rec, TAG_RATIONAL);
+            putI32(rec, static_cast<const Rational*>(v)->numerator);
+            putI32(rec, static_cast<const Rational*>(v)->denominator);
+            break;
+        case V_BOOL:
+            putU8(rec, TAG_BOOL);
+            putU8(rec, static_cast<const Boolean*>(v)->b ? 1 : 0);
+            break;
+        case V_SYM:
+            putU8(rec, TAG_SYM);
+            putStr(rec, static_cast<const Symbol*>(v)->s);
+            break;
+        case V_NULL:
+            putU8(rec, TAG_NULL);
+            break;
+        case V_STRING:
+            putU8(rec, TAG_STRING);
+            putStr(rec, static_cast<const String*>(v)->s);
+            break;
+        case V_PAIR: {
+            const Pair *p = static_cast<const Pair*>(v);
+            putU8(rec, TAG_PAIR);
+            const void *children[2] = {p->car.get(), p->cdr.get()};
+            for (const void *child : children) {
+                uint32_t before = heap_count;
+                uint32_t ref = heap(child);
+                if (heap_count != before) heap_queue.push_back({child, false});
+                putU32(rec, ref);
+            }
+            break;
+        }
+        case V_PROC: {
+            const Procedure *proc = static_cast<const Procedure*>(v);
+            putU8(rec, TAG_PROC);
+            putU32(rec, (uint32_t)proc->parameters.size());
+            for (auto &name : proc->parameters) putStr(rec, name);
+            putU32(rec, code(proc->e));
+            putStr(rec, proc->label != nullptr ? *proc->label : std::string());
+            uint32_t before = heap_count;
+            uint32_t env = heap(proc->env.get());
+            if (heap_count != before) heap_queue.push_back({proc->env.get(), true});
+            putU32(rec, env);
+            break;
+        }
+        case V_PRIMITIVE:
+            putU8(rec, TAG_PRIMITIVE);
+            putStr(rec, static_cast<const Primitive*>(v)->name);
+            break;
+        case V_VOID:
+            putU8(rec, TAG_VOID);
+            break;
+        case V_TERMINATE:
+            putU8(rec, TAG_TERMINATE);
+            break;
+        default:
+            throw RuntimeError("save-image: unsupported value");
+    }
+}
+
+std::string ImageWriter::write(const Assoc &env) {
+    uint32_t root = heap(env.get());
+    if (env.get() != nullptr) heap_queue.push_back({env.get(), true});
+    // Objects are queued in the order their indices were handed out
+    for (size_t i = 0; i < heap_queue.size(); i++) {
+        writeHeapObject(heap_queue[i].first, heap_queue[i].second);
+    }
+
+    ImageHeader header;
+    std::memcpy(header.magic, IMAGE_MAGIC, sizeof(header.magic));
+    header.version = IMAGE_VERSION;
+    header.code_count = code_count;
+    header.heap_count = heap_count;
+    header.root = root;
+
+    std::string image((const char *)&header, sizeof(header));
+    image.append(code_out);
+    image.append(heap_out);
+    return image;
+}
+
+// ============================================================================
+// Reader
+// ============================================================================
+
+class ImageReader {
+public:
+    ImageReader(const char *data, size_t size) : p(data), end(data + size) {}
+    Assoc read();
+
+private:
+    void need(size_t n) {
+        if ((size_t)(end - p) < n) throw RuntimeError("Corrupt image");
+    }
+    uint8_t u8() { need(1); return (uint8_t)*p++; }
+    uint32_t u32() { uint32_t x; need(sizeof(x)); std::memcpy(&x, p, sizeof(x)); p += sizeof(x); return x; }
+    int32_t i32() { int32_t x; need(sizeof(x)); std::memcpy(&x, p, sizeof(x)); p += sizeof(x); return x; }
+    std::string str() { uint32_t n = u32(); need(n); std::string s(p, n); p += n; return s; }
+    static const std::string *label(const std::string &s) { return s.empty() ? nullptr : internLabel(s); }
+
+    Syntax syntaxRef(uint32_t ref);
+    Expr exprRef(uint32_t ref);
+    std::vector<Expr> exprRefs();
+    void readCode(uint32_t index);
+    Expr readExpr();
+
+    const char *p;
+    const char *end;
+    std::vector<Syntax> syntax;   ///< Code objects that are syntax nodes
+    std::vector<Expr> exprs;      ///< Code objects that are expression nodes
+};
+
+Syntax ImageReader::syntaxRef(uint32_t ref) {
+    if (ref == NO_REF) return Syntax(nullptr);
+    if (ref >= syntax.size() || syntax[ref].get() == nullptr) throw RuntimeError("Corrupt image");
+    return syntax[ref];
+}
+
+Expr ImageReader::exprRef(uint32_t ref) {
+    if (ref == NO_REF) return Expr(nullptr);
+    if (ref >= exprs.size() || exprs[ref].get() == nullptr) throw RuntimeError("Corrupt image");
+    return exprs[ref];
+}
+
+std::vector<Expr> ImageReader::exprRefs() {
+    uint32_t n = u32();
+    std::vector<Expr> out;
+    out.reserve(n);
+    for (uint32_t i = 0; i < n; i++) out.push_back(exprRef(u32()));
+    return out;
+}
+
+Expr ImageReader::readExpr() {
+    ExprType type = (ExprType)u8();
+    uint8_t shape = u8();
+    if (shape == SHAPE_VARIADIC) {
+        std::vector<Expr> rands = exprRefs();
+        switch (type) {
+            case E_PLUS:  return Expr(new PlusVar(rands));
+            case E_MINUS: return Expr(new MinusVar(rands));
+            case E_MUL:   return Expr(new MultVar(rands));
+            case E_DIV:   return Expr(new DivVar(rands));
+            case E_LT:    return Expr(new LessVar(rands));
+            case E_LE:    return Expr(new LessEqVar(rands));
+            case E_EQ:    return Expr(new EqualVar(rands));
+            case E_GE:    return Expr(new GreaterEqVar(rands));
+            case E_GT:    return Expr(new GreaterVar(rands));
+            case E_LIST:  return Expr(new ListFunc(rands));
+            case E_AND:   return Expr(new AndVar(rands));
+            case E_OR:    return Expr(new OrVar(rands));
+            case E_BEGIN: return Expr(new Begin(rands));
+            default:      throw RuntimeError("Corrupt image");
+        }
+    }
+    switch (type) {
+        case E_FIXNUM: return Expr(new Fixnum(i32()));
+        case E_RATIONAL: { int n = i32(); int d = i32(); return Expr(new RationalNum(n, d)); }
+        case E_STRING: return Expr(new StringExpr(str()));
+        case E_TRUE:   return Expr(new True());
+        case E_FALSE:  return Expr(new False());
+        case E_VOID:   return Expr(new MakeVoid());
+        case E_EXIT:   return Expr(new Exit());
+
+        // Binary operators
+        case E_PLUS: case E_MINUS: case E_MUL: case E_DIV: case E_MODULO: case E_EXPT:
+        case E_LT: case E_LE: case E_EQ: case E_GE: case E_GT:
+        case E_CONS: case E_SETCAR: case E_SETCDR: case E_EQQ: {
+            Expr a = exprRef(u32());
+            Expr b = exprRef(u32());
+            switch (type) {
+                case E_PLUS:   return Expr(new Plus(a, b));
+                case E_MINUS:  return Expr(new Minus(a, b));
+                case E_MUL:    return Expr(new Mult(a, b));
+                case E_DIV:    return Expr(new Div(a, b));
+                case E_MODULO: return Expr(new Modulo(a, b));
+                case E_EXPT:   return Expr(new Expt(a, b));
+                case E_LT:     return Expr(new Less(a, b));
+                case E_LE:     return Expr(new LessEq(a, b));
+                case E_EQ:     return Expr(new Equal(a, b));
+                case E_GE:     return Expr(new GreaterEq(a, b));
+                case E_GT:     return Expr(new Greater(a, b));
+                case E_CONS:   return Expr(new Cons(a, b));
+                case E_SETCAR: return Expr(new SetCar(a, b));
+                case E_SETCDR: return Expr(new SetCdr(a, b));
+                default:       return Expr(new IsEq(a, b));
+            }
+        }
+
+        // Unary operators
+        case E_CAR: case E_CDR: case E_NOT: case E_BOOLQ: case E_INTQ: case E_NULLQ:
+        case E_PAIRQ: case E_PROCQ: case E_SYMBOLQ: case E_LISTQ: case E_STRINGQ: case E_DISPLAY: {
+            Expr a = exprRef(u32());
+            switch (type) {
+                case E_CAR:     return Expr(new Car(a));
+                case E_CDR:     return Expr(new Cdr(a));
+                case E_NOT:     return Expr(new Not(a));
+                case E_BOOLQ:   return Expr(new IsBoolean(a));
+                case E_INTQ:    return Expr(new IsFixnum(a));
+                case E_NULLQ:   return Expr(new IsNull(a));
+                case E_PAIRQ:   return Expr(new IsPair(a));
+                case E_PROCQ:   return Expr(new IsProcedure(a));
+                case E_SYMBOLQ: return Expr(new IsSymbol(a));
+                case E_LISTQ:   return Expr(new IsList(a));
+                case E_STRINGQ: return Expr(new IsString(a));
+                default:        return Expr(new Display(a));
+            }
+        }
+
+        case E_QUOTE: return Expr(new Quote(syntaxRef(u32())));
+        case E_IF: {
+            Expr c = exprRef(u32());
+            Expr t = exprRef(u32());
+            Expr f = exprRef(u32());
+            return Expr(new If(c, t, f));
+        }
+        case E_COND: {
+            uint32_t n = u32();
+            std::vector<std::vector<Expr>> clauses;
+            for (uint32_t i = 0; i < n; i++) clauses.push_back(exprRefs());
+            return Expr(new Cond(clauses));
+        }
+        case E_VAR: return Expr(new Var(str()));
+        case E_APPLY: {
+            Expr rator = exprRef(u32());
+            return Expr(new Apply(rator, exprRefs()));
+        }
+        case E_LAMBDA: {
+            uint32_t n = u32();
+            std::vector<std::string> params;
+            for (uint32_t i = 0; i < n; i++) params.push_back(str());
+            Expr body = exprRef(u32());
+            return Expr(new Lambda(params, body, label(str())));
+        }
+        case E_DEFINE: { std::string var = str(); return Expr(new Define(var, exprRef(u32()))); }
+        case E_SET:    { std::string var = str(); return Expr(new Set(var, exprRef(u32()))); }
+        case E_LET:
+        case E_LETREC: {
+            uint32_t n = u32();
+            std::vector<std::pair<std::string, Expr>> bind;
+            for (uint32_t i = 0; i < n; i++) {
+                std::string var = str();
+                bind.push_back({var, exprRef(u32())});
+            }
+            Expr body = exprRef(u32());
+            const std::string *name = label(str());
+            if (type == E_LET) return Expr(new Let(bind, body, name));
+            return Expr(new Letrec(bind, body, name));
+        }
+        case E_SAVE_IMAGE: return Expr(new SaveImage(exprRef(u32())));
+        case E_FUTURE:     return Expr(new MakeFuture(exprRef(u32())));
+        case E_TIME:       return Expr(new Time(exprRef(u32())));
+        default:
+            throw RuntimeError("Corrupt image");
+    }
+}
+
+void ImageReader::readCode(uint32_t index) {
+    uint8_t tag = u8();
+    switch (tag) {
+        case TAG_SYN_NUMBER:   syntax[index] = Syntax(new Number(i32())); break;
+        case TAG_SYN_RATIONAL: { int n = i32(); int d = i32(); syntax[index] = Syntax(new RationalSyntax(n, d)); break; }
+        case TAG_SYN_TRUE:     syntax[index] = Syntax(new TrueSyntax()); break;
+        case TAG_SYN_FALSE:    syntax[index] = Syntax(new FalseSyntax()); break;
+        case TAG_SYN_SYMBOL:   syntax[index] = Syntax(new SymbolSyntax(str())); break;
+        case TAG_SYN_STRING:   syntax[index] = Syntax(new StringSyntax(str())); break;
+        case TAG_SYN_LIST: {
+            List *lst = new List();
+            syntax[index] = Syntax(lst);
+            uint32_t n = u32();
+            for (uint32_t i = 0; i < n; i++) lst->stxs.push_back(syntaxRef(u32()));
+            break;
+        }
+        case TAG_EXPR: exprs[index] = readExpr(); break;
+        default: throw RuntimeError("Corrupt image");
+    }
+}
+
+Assoc ImageReader::read() {
+    ImageHeader header;
+    need(sizeof(header));
+    std::memcpy(&header, p, sizeof(header));
+    p += sizeof(header);
+    if (std::memcmp(header.magic, IMAGE_MAGIC, sizeof(header.magic)) != 0 || header.version != IMAGE_VERSION) {
+        throw RuntimeError("Not a heap image");
+    }
+
+    syntax.assign(header.code_count, Syntax(nullptr));
+    exprs.assign(header.code_count, Expr(nullptr));
+    for (uint32_t i = 0; i < header.code_count; i++) readCode(i);
+
+    // First pass: create every heap object, remembering the references to relocate
+    struct Fixup { uint32_t index; uint32_t a; uint32_t b; };
+    uint32_t n = header.heap_count;
+    std::vector<Value> values(n, Value(nullptr));
+    std::vector<Assoc> envs(n, Assoc(nullptr));
+    std::vector<Fixup> pairs, procs, nodes;
+    Assoc no_env = empty();
+    for (uint32_t i = 0; i < n; i++) {
+        uint8_t tag = u8();
+        switch (tag) {
+            case TAG_INT:      values[i] = IntegerV(i32()); break;
+            case TAG_RATIONAL: { int num = i32(); int den = i32(); values[i] = RationalV(num, den); break; }
+            case TAG_BOOL:     values[i] = BooleanV(u8() != 0); break;
+            case TAG_SYM:      values[i] = SymbolV(str()); break;
+            case TAG_NULL:     values[i] = NullV(); break;
+            case TAG_STRING:   values[i] = StringV(str()); break;
+            case TAG_VOID:     values[i] = VoidV(); break;
+            case TAG_TERMINATE: values[i] = TerminateV(); break;
+            case TAG_PAIR: {
+                uint32_t car = u32();
+                uint32_t cdr = u32();
+                values[i] = PairV(Value(nullptr), Value(nullptr));
+                pairs.push_back({i, car, cdr});
+                break;
+            }
+            case TAG_PROC: {
+                uint32_t count = u32();
+                std::vector<std::string> params;
+                for (uint32_t k = 0; k < count; k++) params.push_back(str());
+                Expr body = exprRef(u32());
+                const std::string *name = label(str());
+                values[i] = ProcedureV(params, body, no_env, name);
+                procs.push_back({i, u32(), 0});
+                break;
+            }
+            case TAG_PRIMITIVE: {
+                Var name(str());
+                values[i] = name.eval(no_env);
+                break;
+            }
+            case TAG_ENV: {
+                std::string x = str();
+                uint32_t v = u32();
+                uint32_t next = u32();
+                envs[i] = extend(x, Value(nullptr), no_env);
+                nodes.push_back({i, v, next});
+                break;
+            }
+            default:
+                throw RuntimeError("Corrupt image");
+        }
+    }
+
+    // Second pass: relocate indices to the objects created above
+    auto value = [&](uint32_t ref) -> Value {
+        if (ref == NO_REF) return Value(nullptr);
+        if (ref >= n || values[ref].get() == nullptr) throw RuntimeError("Corrupt image");
+        return values[ref];
+    };
+    auto env = [&](uint32_t ref) -> Assoc {
+        if (ref == NO_REF) return Assoc(nullptr);
+        if (ref >= n || envs[ref].get() == nullptr) throw RuntimeError("Corrupt image");
+        return envs[ref];
+    };
+    for (auto &f : pairs) {
+        Pair *pair = static_cast<Pair*>(values[f.index].get());
+        pair->car = value(f.a);
+        pair->cdr = value(f.b);
+    }
+    for (auto &f : procs) {
+        static_cast<Procedure*>(values[f.index].get())->env = env(f.a);
+    }
+    for (auto &f : nodes) {
+        envs[f.index]->v = value(f.a);
+        envs[f.index]->next = env(f.b);
+    }
+    return env(header.root);
+}
+
+} // namespace
+
+void saveImage(const std::string &path, const Assoc &env) {
+    ImageWriter writer;
+    std::string image = writer.write(env);
+
+    std::string tmp = path + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw RuntimeError("save-image: cannot open " + path);
+    }
+    const char *p = image.data();
+    size_t left = image.size();
+    while (left > 0) {
+        ssize_t n = ::write(fd, p, left);
+        if (n < 0) {
+            close(fd);
+            unlink(tmp.c_str());
+            throw RuntimeError("save-image: write failed");
+        }
+        p += n;
+        left -= n;
+    }
+    close(fd);
+    if (rename(tmp.c_str(), path.c_str()) != 0) {
+        unlink(tmp.c_str());
+        throw RuntimeError("save-image: cannot replace " + path);
+    }
+}
+
+Assoc loadImage(const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw RuntimeError("Cannot open image " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        throw RuntimeError("Cannot read image " + path);
+    }
+    void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        throw RuntimeError("Cannot map image " + path);
+    }
+    try {
+        ImageReader reader(static_cast<const char *>(data), st.st_size);
+        Assoc env = reader.read();
+        munmap(data, st.st_size);
+        return env;
+    } catch (...) {
+        munmap(data, st.st_size);
+        throw;
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef IMAGE_HPP
+#define IMAGE_HPP
+
+/**
+ * @file image.hpp
+ * @brief Heap image snapshot and restore
+ *
+ * An image is a binary dump of an environment chain together with every
+ * value, closure environment, expression tree and quoted syntax reachable
+ * from it. Restoring one skips reading, parsing and evaluating the source
+ * that built the environment in the first place.
+ *
+ * Layout: a fixed header followed by the code section (syntax and
+ * expression nodes, children before parents) and the heap section (values
+ * and environment nodes). Objects refer to each other by index; the loader
+ * maps the file read-only, builds the objects in one pass and relocates the
+ * heap indices to pointers in a second pass, which also restores cycles.
+ */
+
+#include "value.hpp"
+#include <string>
+
+// Writes env and everything reachable from it to path
+void saveImage(const std::string &path, const Assoc &env);
+
+// Maps the image at path and returns the environment it contains
+Assoc loadImage(const std::string &path);
+
+#endif // IMAGE_HPP
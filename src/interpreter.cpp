@@ -0,0 +1,521 @@
+/**
+ * @file interpreter.cpp
+ * @brief Implementation of the embeddable interpreter object
+ */
+
+#include "interpreter.hpp"
+#include "syntax.hpp"
+#include "expr.hpp"
+#include "image.hpp"
+#include "perf.hpp"
+#include "trace.hpp"
+#include "green.hpp"
+#include <algorithm>
+#include <sstream>
+#include <map>
+#include <set>
+
+extern const std::map<std::string, ExprType> primitives;
+extern const std::map<std::string, ExprType> reserved_words;
+
+/**
+ * @brief Installs an interpreter's output stream and binding overlay for one call
+ */
+struct CallScope {
+    std::ostream *saved;
+    std::shared_ptr<EnvOverlay> saved_overlay;
+    CallScope(std::ostream *os, const std::shared_ptr<EnvOverlay> &overlay)
+        : saved(&outputStream()), saved_overlay(activeOverlay()) {
+        if (os != nullptr) setOutputStream(os);
+        setActiveOverlay(overlay);
+    }
+    ~CallScope() {
+        setOutputStream(saved);
+        setActiveOverlay(saved_overlay);
+    }
+};
+
+// 检查表达式是否是显式的 void 调用或在允许的嵌套结构中
+bool isExplicitVoidCall(Expr expr) {
+    // 检查是否是直接的 MakeVoid (即 (void))
+    MakeVoid* make_void_expr = dynamic_cast<MakeVoid*>(expr.get());
+    if (make_void_expr != nullptr) {
+        return true;
+    }
+
+    // 检查是否是 Apply 表达式调用 void
+    Apply* apply_expr = dynamic_cast<Apply*>(expr.get());
+    if (apply_expr != nullptr) {
+        Var* var_expr = dynamic_cast<Var*>(apply_expr->rator.get());
+        if (var_expr != nullptr && var_expr->x == "void") {
+            return true;
+        }
+    }
+
+    // 检查是否是 begin 表达式，且最后一个表达式是 void 调用
+    Begin* begin_expr = dynamic_cast<Begin*>(expr.get());
+    if (begin_expr != nullptr && !begin_expr->es.empty()) {
+        return isExplicitVoidCall(begin_expr->es.back());
+    }
+
+    // 检查是否是 if 表达式的分支包含显式 void 调用
+    If* if_expr = dynamic_cast<If*>(expr.get());
+    if (if_expr != nullptr) {
+        return isExplicitVoidCall(if_expr->conseq) || isExplicitVoidCall(if_expr->alter);
+    }
+
+    // 检查是否是 cond 表达式的某个分支包含显式 void 调用
+    Cond* cond_expr = dynamic_cast<Cond*>(expr.get());
+    if (cond_expr != nullptr) {
+        for (const auto& clause : cond_expr->clauses) {
+            if (clause.size() > 1 && isExplicitVoidCall(clause.back())) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+namespace {
+
+/**
+ * @brief Global names an expression refers to without binding them itself
+ */
+class FreeNames {
+public:
+    explicit FreeNames(std::set<std::string> &out) : out(out) {}
+
+    void walk(const Expr &expr) {
+        ExprBase *e = expr.get();
+        switch (e->e_type) {
+            case E_VAR:
+                use(static_cast<Var*>(e)->x);
+                return;
+            case E_QUOTE:
+                return;
+            case E_SET:
+                use(static_cast<Set*>(e)->var);
+                walk(static_cast<Set*>(e)->e);
+                return;
+            case E_DEFINE:
+                // 内部 define 只建立局部绑定
+                bound.push_back(static_cast<Define*>(e)->var);
+                walk(static_cast<Define*>(e)->e);
+                return;
+            case E_LAMBDA: {
+                Lambda *node = static_cast<Lambda*>(e);
+                size_t mark = bound.size();
+                bound.insert(bound.end(), node->x.begin(), node->x.end());
+                walk(node->e);
+                bound.resize(mark);
+                return;
+            }
+            case E_BEGIN: {
+                size_t mark = bound.size();
+                for (auto &sub : static_cast<Begin*>(e)->es) walk(sub);
+                bound.resize(mark);
+                return;
+            }
+            case E_LET:
+            case E_LETREC: {
+                size_t mark = bound.size();
+                bool rec = e->e_type == E_LETREC;
+                auto &bind_list = rec ? static_cast<Letrec*>(e)->bind : static_cast<Let*>(e)->bind;
+                if (rec) for (auto &b : bind_list) bound.push_back(b.first);
+                for (auto &b : bind_list) walk(b.second);
+                if (!rec) for (auto &b : bind_list) bound.push_back(b.first);
+                walk(rec ? static_cast<Letrec*>(e)->body : static_cast<Let*>(e)->body);
+                bound.resize(mark);
+                return;
+            }
+            case E_IF: {
+                If *node = static_cast<If*>(e);
+                walk(node->cond);
+                walk(node->conseq);
+                walk(node->alter);
+                return;
+            }
+            case E_COND:
+                for (auto &clause : static_cast<Cond*>(e)->clauses)
+                    for (auto &sub : clause)
+                        if (sub->e_type != E_VAR || static_cast<Var*>(sub.get())->x != "else") walk(sub);
+                return;
+            case E_AND:
+                for (auto &sub : static_cast<AndVar*>(e)->rands) walk(sub);
+                return;
+            case E_OR:
+                for (auto &sub : static_cast<OrVar*>(e)->rands) walk(sub);
+                return;
+            case E_APPLY:
+                walk(static_cast<Apply*>(e)->rator);
+                for (auto &sub : static_cast<Apply*>(e)->rand) walk(sub);
+                return;
+            default:
+                break;
+        }
+        if (auto u = dynamic_cast<Unary*>(e)) {
+            walk(u->rand);
+        } else if (auto b = dynamic_cast<Binary*>(e)) {
+            walk(b->rand1);
+            walk(b->rand2);
+        } else if (auto v = dynamic_cast<Variadic*>(e)) {
+            for (auto &sub : v->rands) walk(sub);
+        } else if (auto f = dynamic_cast<MakeFuture*>(e)) {
+            walk(f->e);
+        } else if (auto t = dynamic_cast<Time*>(e)) {
+            walk(t->e);
+        } else if (auto i = dynamic_cast<SaveImage*>(e)) {
+            walk(i->file);
+        }
+    }
+
+private:
+    void use(const std::string &name) {
+        if (std::find(bound.begin(), bound.end(), name) == bound.end()) out.insert(name);
+    }
+
+    std::set<std::string> &out;
+    std::vector<std::string> bound;
+};
+
+// Node of the innermost binding of x, even one whose value is still a placeholder
+AssocList *bindingNode(const std::string &x, const Assoc &env) {
+    for (auto i = env; i.get() != nullptr; i = i->next) {
+        if (x == i->x) return i.get();
+    }
+    return nullptr;
+}
+
+} // namespace
+
+ReplOptions::ReplOptions()
+    : prompt(true), reuse_bindings(false), max_pending_defines(0), window(nullptr) {}
+
+Interpreter::Interpreter() : global_env(empty()), output(nullptr), limits(defaultLimits()) {}
+
+/**
+ * @brief Batch processing of multiple define statements supporting mutual recursion
+ *
+ * With reuse_bindings set, a name that is already bound in the global
+ * environment is updated in place instead of being shadowed by a new node,
+ * so a stream that keeps redefining the same globals does not grow it.
+ * A name whose binding is still a placeholder is always filled in place.
+ */
+Value Interpreter::evaluateDefineGroup(const std::vector<std::pair<std::string, Expr>>& defines,
+                                       bool reuse_bindings) {
+    Assoc &env = global_env;
+    // 第一阶段：为所有变量创建占位符绑定
+    for (const auto& def : defines) {
+        if (primitives.count(def.first) || reserved_words.count(def.first)) {
+            throw RuntimeError("Cannot redefine primitive: " + def.first);
+        }
+        AssocList *node = bindingNode(def.first, env);
+        if (node != nullptr && (reuse_bindings || bindingValue(node).get() == nullptr)) {
+            continue;
+        }
+        env = extend(def.first, Value(nullptr), env);
+    }
+
+    // 第二阶段：求值所有表达式并更新绑定
+    Value last_result = VoidV();
+    for (const auto& def : defines) {
+        Value val = def.second->eval(env);
+        modify(def.first, val, env);
+        last_result = VoidV(); // define 总是返回 void
+    }
+
+    return last_result;
+}
+
+/**
+ * @brief Placeholders for the free names of a define group that nothing binds yet
+ *
+ * A group cut off by max_pending_defines may refer to names defined after
+ * it. Binding them now, below the group's own names, puts them in the
+ * environments its closures capture; the later define fills the same node
+ * (see evaluateDefineGroup), so splitting a run of defines does not change
+ * what they see.
+ */
+void Interpreter::bindForwardReferences(const std::vector<std::pair<std::string, Expr>> &defines) {
+    std::set<std::string> names;
+    FreeNames walker(names);
+    for (const auto &def : defines) walker.walk(def.second);
+    for (const auto &def : defines) names.erase(def.first);
+    for (const std::string &name : names) {
+        if (primitives.count(name) || reserved_words.count(name) || bindingNode(name, global_env) != nullptr)
+            continue;
+        global_env = extend(name, Value(nullptr), global_env);
+    }
+}
+
+int Interpreter::repl(std::istream &in, const ReplOptions &opts){
+    // read - evaluation - print loop with define grouping
+    CallScope scope(output, overlay);
+    ReaderLines lines;
+    std::ostream &out = outputStream();
+    std::vector<std::pair<std::string, Expr>> pending_defines;
+    int errors = 0;
+
+    while (1){
+        #ifndef ONLINE_JUDGE
+            if (opts.prompt)
+                out << "scm> ";
+        #endif
+        if (opts.window != nullptr)
+            opts.window->beginForm();
+        if (readSpace(in).peek() == EOF)
+            break;
+        int line = reader_line;
+        try{
+            Syntax stx = readSyntax(in); // read
+            Expr expr = stx->parse(global_env); // parse
+            BudgetScope budget(limits);  // 读取输入不计入配额与超时
+
+            // 检查是否是 define 表达式
+            Define* define_expr = dynamic_cast<Define*>(expr.get());
+            if (define_expr != nullptr) {
+                // 收集 define 表达式
+                pending_defines.push_back({define_expr->var, define_expr->e});
+                // 窗口已满时先求值这一组，再继续读取（背压）
+                if (opts.max_pending_defines != 0 && pending_defines.size() >= opts.max_pending_defines) {
+                    bindForwardReferences(pending_defines);
+                    evaluateDefineGroup(pending_defines, opts.reuse_bindings);
+                    pending_defines.clear();
+                    greenRunAll();
+                }
+                continue;
+            } else {
+                // 不是 define 表达式
+                PerfScope perf(line);
+                TraceScope trace(line);
+                // 如果有待处理的 define，先批量处理它们
+                if (!pending_defines.empty()) {
+                    evaluateDefineGroup(pending_defines, opts.reuse_bindings);
+                    pending_defines.clear();
+                }
+
+                // 处理当前的非 define 表达式
+                Value val = expr->eval(global_env);
+                if (val->v_type == V_TERMINATE)
+                    break;
+                // 表达式返回前先运行完它启动的绿色线程
+                greenRunAll();
+
+                // 简化的显示逻辑：
+                // 如果结果是 void，只有在显式调用 (void) 或在允许的嵌套结构中时才显示
+                if (val->v_type == V_VOID) {
+                    if (isExplicitVoidCall(expr)) {
+                        val->show(out);
+                        out << '\n';
+                    }
+                    // 其他返回 void 的表达式不输出任何内容
+                } else {
+                    // 非 void 结果正常显示
+                    val->show(out);
+                    out << '\n';
+                }
+            }
+        }
+        catch (const RuntimeError &RE){
+            // 如果出错，清空待处理的 define
+            pending_defines.clear();
+            errors++;
+            out << "RuntimeError\n";
+            finishGreenThreads();
+            if (opts.window != nullptr && opts.window->formTooLarge())
+                break; // 无法在超长的表达式之后重新同步
+        }
+    }
+
+    // 如果程序结束时还有待处理的 define，处理它们
+    if (!pending_defines.empty()) {
+        try {
+            BudgetScope budget(limits);
+            evaluateDefineGroup(pending_defines, opts.reuse_bindings);
+            greenRunAll();
+        } catch (const RuntimeError &RE) {
+            errors++;
+            out << "RuntimeError in final defines\n";
+            finishGreenThreads();
+        }
+    }
+    return errors;
+}
+
+
+
+Value Interpreter::eval(const std::string &source) {
+    CallScope scope(output, overlay);
+    BudgetScope budget(limits);
+    ReaderLines lines;
+    std::istringstream in(source);
+    std::vector<std::pair<std::string, Expr>> pending_defines;
+    Value result = VoidV();
+    try {
+        while (readSpace(in).peek() != EOF) {
+            int line = reader_line;
+            Syntax stx = readSyntax(in);
+            Expr expr = stx->parse(global_env);
+            Define* define_expr = dynamic_cast<Define*>(expr.get());
+            if (define_expr != nullptr) {
+                pending_defines.push_back({define_expr->var, define_expr->e});
+                result = VoidV();
+                continue;
+            }
+            TraceScope trace(line);
+            if (!pending_defines.empty()) {
+                evaluateDefineGroup(pending_defines, false);
+                pending_defines.clear();
+            }
+            result = expr->eval(global_env);
+            if (result->v_type == V_TERMINATE)
+                return result;
+        }
+        if (!pending_defines.empty()) {
+            evaluateDefineGroup(pending_defines, false);
+        }
+        greenRunAll();
+    } catch (...) {
+        outputStream().flush();
+        throw;
+    }
+    return result;
+}
+
+Value Interpreter::call(const Value &proc, const std::vector<Value> &args) {
+    CallScope scope(output, overlay);
+    BudgetScope budget(limits);
+    Value result = applyProcedure(proc, args);
+    greenRunAll();
+    return result;
+}
+
+Value Interpreter::call(const std::string &name, const std::vector<Value> &args) {
+    return call(lookup(name), args);
+}
+
+Value Interpreter::lookup(const std::string &name) {
+    CallScope scope(output, overlay);
+    Var var(name);
+    return var.eval(global_env);
+}
+
+void Interpreter::define(const std::string &name, const Value &value) {
+    CallScope scope(output, overlay);
+    if (primitives.count(name) || reserved_words.count(name)) {
+        throw RuntimeError("Cannot redefine primitive: " + name);
+    }
+    if (find(name, global_env).get() != nullptr) {
+        modify(name, value, global_env);
+    } else {
+        global_env = extend(name, value, global_env);
+    }
+}
+
+Assoc &Interpreter::globals() {
+    return global_env;
+}
+
+void Interpreter::finishGreenThreads() {
+    // 失败的表达式可能已用完自己的预算，剩下的绿色线程在新的预算下运行完；
+    // 它们的错误在各自的入口处报告
+    BudgetScope budget(limits);
+    greenRunAll();
+}
+
+Interpreter Interpreter::fork() const {
+    unsigned long generation = freezeEnvironments();
+    Interpreter session(*this);
+    if (overlay) {
+        // 父会话此后写入快照中的绑定也进入自己的 overlay，子会话看不到
+        overlay->frozen = generation;
+        overlay->shared_pairs = generation;
+        session.overlay = std::make_shared<EnvOverlay>(*overlay);
+    } else {
+        session.overlay = std::make_shared<EnvOverlay>(generation, generation);
+    }
+    return session;
+}
+
+void Interpreter::saveImage(const std::string &path) {
+    CallScope scope(output, overlay);
+    ::saveImage(path, global_env);
+}
+
+void Interpreter::loadImage(const std::string &path) {
+    global_env = ::loadImage(path);
+}
+
+void Interpreter::setOutput(std::ostream *os) {
+    output = os;
+}
+
+void Interpreter::setLimits(const Limits &l) {
+    limits = l;
+}
+
+// ============================================================================
+// Value conversion helpers
+// ============================================================================
+
+Value Interpreter::fromInt(int n) {
+    return IntegerV(n);
+}
+
+Value Interpreter::fromBool(bool b) {
+    return BooleanV(b);
+}
+
+Value Interpreter::fromString(const std::string &s) {
+    return StringV(s);
+}
+
+Value Interpreter::fromSymbol(const std::string &s) {
+    return SymbolV(s);
+}
+
+Value Interpreter::fromList(const std::vector<Value> &items) {
+    Value result = NullV();
+    for (size_t i = items.size(); i > 0; i--) {
+        result = PairV(items[i - 1], result);
+    }
+    return result;
+}
+
+int Interpreter::toInt(const Value &v) {
+    if (v->v_type != V_INT) {
+        throw RuntimeError("Expected an integer");
+    }
+    return static_cast<Integer*>(v.get())->n;
+}
+
+bool Interpreter::toBool(const Value &v) {
+    return !(v->v_type == V_BOOL && !static_cast<Boolean*>(v.get())->b);
+}
+
+std::string Interpreter::toString(const Value &v) {
+    if (v->v_type == V_STRING) {
+        return static_cast<String*>(v.get())->s;
+    }
+    if (v->v_type == V_SYM) {
+        return static_cast<Symbol*>(v.get())->s;
+    }
+    std::ostringstream os;
+    v->show(os);
+    return os.str();
+}
+
+std::vector<Value> Interpreter::toList(const Value &v) {
+    std::vector<Value> items;
+    Value cur = v;
+    while (cur->v_type == V_PAIR) {
+        Pair *p = static_cast<Pair*>(cur.get());
+        items.push_back(p->car);
+        cur = p->cdr;
+    }
+    if (cur->v_type != V_NULL) {
+        throw RuntimeError("Expected a proper list");
+    }
+    return items;
+}
@@ -0,0 +1,104 @@
+#ifndef INTERPRETER_HPP
+#define INTERPRETER_HPP
+
+/**
+ * @file interpreter.hpp
+ * @brief Embeddable interpreter object
+ *
+ * An Interpreter owns one global environment and everything needed to
+ * read, evaluate and print top-level forms against it. Instances share no
+ * mutable state, so a host program can create as many as it needs and
+ * keep them alive across requests instead of starting a process per job.
+ */
+
+#include "Def.hpp"
+#include "value.hpp"
+#include "RE.hpp"
+#include "io.hpp"
+#include "limits.hpp"
+#include <string>
+#include <vector>
+#include <iostream>
+
+/**
+ * @brief Options of the top-level read-eval-print loop
+ */
+struct ReplOptions {
+    bool prompt;                 ///< Print "scm> " before every form
+    bool reuse_bindings;         ///< Top-level redefinition updates the existing binding
+    size_t max_pending_defines;  ///< Define group is evaluated once it reaches this size (0: unbounded)
+    InputWindow *window;         ///< Input window of the stream, if any
+    ReplOptions();
+};
+
+class Interpreter {
+public:
+    Interpreter();
+
+    /**
+     * @brief Evaluates every form in source and returns the last value
+     *
+     * Consecutive defines are grouped as in the REPL so they may refer to
+     * each other. Errors are thrown as RuntimeError.
+     */
+    Value eval(const std::string &source);
+
+    // Applies a procedure value (or the procedure bound to name) to arguments
+    Value call(const Value &proc, const std::vector<Value> &args);
+    Value call(const std::string &name, const std::vector<Value> &args);
+
+    // Global bindings
+    Value lookup(const std::string &name);
+    void define(const std::string &name, const Value &value);
+    Assoc &globals();
+
+    /**
+     * @brief Returns a session running against a copy-on-write snapshot of the globals
+     *
+     * Forking is O(1) in the size of the environment; bindings the session
+     * defines or set!s stay private to it. A forked parent keeps its later
+     * writes to shared bindings in its own overlay; the root session has
+     * none, so it should not set! shared bindings while its sessions are in
+     * use, since those writes go in place.
+     */
+    Interpreter fork() const;
+
+    // Heap images: write the global environment to path, or replace it with the one stored there
+    void saveImage(const std::string &path);
+    void loadImage(const std::string &path);
+
+    /**
+     * @brief Runs the read-eval-print loop over in
+     * @return Number of forms that ended in a RuntimeError
+     */
+    int repl(std::istream &in, const ReplOptions &opts);
+
+    // Stream receiving display output and printed results (default: outputStream())
+    void setOutput(std::ostream *);
+
+    // Quotas of each top-level form, eval and call (default: defaultLimits(); inherited by fork)
+    void setLimits(const Limits &);
+
+    // Value conversion helpers; the to* functions throw RuntimeError on a type mismatch
+    static Value fromInt(int);
+    static Value fromBool(bool);
+    static Value fromString(const std::string &);
+    static Value fromSymbol(const std::string &);
+    static Value fromList(const std::vector<Value> &);
+    static int toInt(const Value &);
+    static bool toBool(const Value &);          ///< Scheme truthiness: only #f is false
+    static std::string toString(const Value &); ///< String contents, or the printed form of any other value
+    static std::vector<Value> toList(const Value &);
+
+private:
+    Value evaluateDefineGroup(const std::vector<std::pair<std::string, Expr>> &, bool reuse_bindings);
+    void bindForwardReferences(const std::vector<std::pair<std::string, Expr>> &);
+    void finishGreenThreads();   ///< Runs the green threads a failed form left runnable
+
+    Assoc global_env;
+    std::ostream *output;
+    Limits limits;
+    std::shared_ptr<EnvOverlay> overlay;   ///< Private bindings of a forked session (null for the root)
+};
+
+#endif // INTERPRETER_HPP
@@ -0,0 +1,127 @@
+/**
+ * @file io.cpp
+ * @brief Implementation of the buffered stream adapters
+ */
+
+#include "io.hpp"
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+// ============================================================================
+// InputWindow Implementation
+// ============================================================================
+
+InputWindow::InputWindow(int fd, size_t capacity, size_t max_form_bytes)
+    : fd(fd), window(capacity), max_form_bytes(max_form_bytes),
+      loaded(0), form_start(0), too_large(false) {
+    setg(window.data(), window.data(), window.data());
+}
+
+void InputWindow::beginForm() {
+    form_start = loaded - (egptr() - gptr());
+    too_large = false;
+}
+
+bool InputWindow::formTooLarge() const {
+    return too_large;
+}
+
+InputWindow::int_type InputWindow::underflow() {
+    if (gptr() < egptr()) {
+        return traits_type::to_int_type(*gptr());
+    }
+    if (max_form_bytes != 0 && loaded - form_start >= max_form_bytes) {
+        too_large = true;
+        return traits_type::eof();
+    }
+    ssize_t n;
+    do {
+        n = read(fd, window.data(), window.size());
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        return traits_type::eof();
+    }
+    loaded += n;
+    setg(window.data(), window.data(), window.data() + n);
+    return traits_type::to_int_type(*gptr());
+}
+
+// ============================================================================
+// OutputBuffer Implementation
+// ============================================================================
+
+OutputBuffer::OutputBuffer(int fd, size_t capacity) : fd(fd), buffer(capacity) {
+    setp(buffer.data(), buffer.data() + buffer.size());
+}
+
+OutputBuffer::~OutputBuffer() {
+    drain();
+}
+
+bool OutputBuffer::drain() {
+    const char *p = pbase();
+    while (p < pptr()) {
+        ssize_t n = write(fd, p, pptr() - p);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            setp(buffer.data(), buffer.data() + buffer.size());
+            return false;
+        }
+        p += n;
+    }
+    setp(buffer.data(), buffer.data() + buffer.size());
+    return true;
+}
+
+OutputBuffer::int_type OutputBuffer::overflow(int_type c) {
+    if (!drain()) {
+        return traits_type::eof();
+    }
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+std::streamsize OutputBuffer::xsputn(const char *s, std::streamsize n) {
+    std::streamsize done = 0;
+    while (done < n) {
+        std::streamsize room = epptr() - pptr();
+        if (room == 0) {
+            if (!drain()) break;
+            continue;
+        }
+        std::streamsize chunk = (n - done < room) ? n - done : room;
+        std::memcpy(pptr(), s + done, chunk);
+        pbump((int)chunk);
+        done += chunk;
+    }
+    return done;
+}
+
+int OutputBuffer::sync() {
+    return drain() ? 0 : -1;
+}
+
+// ============================================================================
+// Program output stream
+// ============================================================================
+
+// 每个线程有自己的输出目标，并发执行的脚本互不干扰
+static thread_local std::ostream *program_output = &std::cout;
+
+std::ostream &outputStream() {
+    return *program_output;
+}
+
+void setOutputStream(std::ostream *os) {
+    program_output = (os != nullptr) ? os : &std::cout;
+}
+
+std::vector<std::string> &commandLine() {
+    static std::vector<std::string> args;
+    return args;
+}
@@ -0,0 +1,72 @@
+#ifndef IO_HPP
+#define IO_HPP
+
+/**
+ * @file io.hpp
+ * @brief Buffered stream adapters used by the batch execution modes
+ *
+ * These classes sit between the interpreter and the underlying file
+ * descriptors so that memory held for program text stays bounded and
+ * independent of the input length.
+ */
+
+#include <streambuf>
+#include <ostream>
+#include <vector>
+#include <string>
+#include <cstddef>
+
+/**
+ * @brief Fixed-size read window over a file descriptor
+ *
+ * Input is pulled in chunks of at most the window capacity, so unread
+ * program text held in memory never grows with the input length. The
+ * window also tracks how many bytes the current top-level form has
+ * consumed; once a form exceeds the limit it reports end-of-file, which
+ * the reader turns into a RuntimeError.
+ */
+class InputWindow : public std::streambuf {
+public:
+    InputWindow(int fd, size_t capacity, size_t max_form_bytes);
+    void beginForm();           ///< Start counting bytes for a new top-level form
+    bool formTooLarge() const;  ///< True once the current form hit the limit
+protected:
+    virtual int_type underflow() override;
+private:
+    int fd;
+    std::vector<char> window;
+    size_t max_form_bytes;
+    size_t loaded;              ///< Total bytes read from fd so far
+    size_t form_start;          ///< Stream offset where the current form began
+    bool too_large;
+};
+
+/**
+ * @brief Large write buffer over a file descriptor
+ *
+ * Everything the program prints is collected here and handed to write(2)
+ * only when the buffer fills up, on an explicit flush, or on destruction,
+ * so output-heavy scripts do not pay a system call per line.
+ */
+class OutputBuffer : public std::streambuf {
+public:
+    OutputBuffer(int fd, size_t capacity);
+    virtual ~OutputBuffer();
+protected:
+    virtual int_type overflow(int_type) override;
+    virtual std::streamsize xsputn(const char *, std::streamsize) override;
+    virtual int sync() override;
+private:
+    bool drain();
+    int fd;
+    std::vector<char> buffer;
+};
+
+// Stream that receives program output (display, printed results); set per thread
+std::ostream &outputStream();
+void setOutputStream(std::ostream *);
+
+// Script path and arguments reported by (command-line)
+std::vector<std::string> &commandLine();
+
+#endif // IO_HPP
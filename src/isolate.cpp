@@ -0,0 +1,321 @@
+/**
+ * @file isolate.cpp
+ * @brief Implementation of isolates and their mailboxes
+ */
+
+#include "isolate.hpp"
+#include "interpreter.hpp"
+#include "RE.hpp"
+#include "io.hpp"
+#include "safepoint.hpp"
+#include "allocation.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+struct MessageNode {
+    std::atomic<MessageNode *> next;
+    Value value;
+    MessageNode() : next(nullptr), value(nullptr) {}
+    explicit MessageNode(const Value &v) : next(nullptr), value(v) {}
+};
+
+/**
+ * @brief Vyukov's intrusive MPSC queue
+ *
+ * Producers only exchange the head pointer and link the previous node;
+ * the single consumer walks from the tail. A stub node keeps the queue
+ * non-empty so push never has to check for the empty case.
+ */
+class MessageQueue {
+public:
+    MessageQueue() : head(&stub), tail(&stub) {}
+
+    ~MessageQueue() {
+        while (MessageNode *n = pop()) delete n;
+    }
+
+    void push(MessageNode *n) {
+        n->next.store(nullptr, std::memory_order_relaxed);
+        MessageNode *prev = head.exchange(n, std::memory_order_acq_rel);
+        prev->next.store(n, std::memory_order_release);
+    }
+
+    // Returns nullptr when empty or while a producer is halfway through a push
+    MessageNode *pop() {
+        MessageNode *t = tail;
+        MessageNode *next = t->next.load(std::memory_order_acquire);
+        if (t == &stub) {
+            if (next == nullptr) return nullptr;
+            tail = next;
+            t = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        if (next != nullptr) {
+            tail = next;
+            return t;
+        }
+        if (t != head.load(std::memory_order_acquire)) return nullptr;
+        push(&stub);
+        next = t->next.load(std::memory_order_acquire);
+        if (next != nullptr) {
+            tail = next;
+            return t;
+        }
+        return nullptr;
+    }
+
+private:
+    std::atomic<MessageNode *> head;
+    MessageNode *tail;
+    MessageNode stub;
+};
+
+// A blocked receiver wakes this often only to poll its safepoint (interrupts, timeouts)
+const int SAFEPOINT_WAKE_MS = 100;
+
+} // namespace
+
+struct IsolateState;
+
+/**
+ * @brief Isolate threads and how many of them are blocked, never destroyed
+ */
+struct IsolateRegistry {
+    std::mutex lock;                            ///< Guards everything below
+    std::condition_variable changed;            ///< running or blocked changed
+    std::vector<std::thread> threads;           ///< Not yet joined
+    std::vector<std::weak_ptr<IsolateState>> states;
+    int running;                                ///< Isolates whose script has not finished
+    int blocked;                                ///< Running isolates waiting on an empty mailbox
+    std::atomic<bool> closing;                  ///< The main program has ended and nothing can send
+    IsolateRegistry() : running(0), blocked(0), closing(false) {}
+};
+
+static IsolateRegistry &registry() {
+    static IsolateRegistry *instance = new IsolateRegistry();
+    return *instance;
+}
+
+struct IsolateState {
+    MessageQueue queue;
+    std::shared_ptr<IsolateState> parent;
+    std::atomic<bool> sleeping;     ///< Receiver is (about to be) blocked on the condition variable
+    std::mutex lock;
+    std::condition_variable wakeup;
+    IsolateState() : sleeping(false) {}
+
+    void send(const Value &v) {
+        queue.push(new MessageNode(v));
+        // 与 receive 中 sleeping 的写入和队列的复查配对：两边至少有一边看到对方
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleeping.load()) {
+            std::lock_guard<std::mutex> guard(lock);
+            wakeup.notify_one();
+        }
+    }
+
+    Value receive() {
+        for (int spin = 0; ; spin++) {
+            if (MessageNode *n = queue.pop()) {
+                Value v = n->value;
+                delete n;
+                return v;
+            }
+            if (spin < 100) {
+                std::this_thread::yield();
+                continue;
+            }
+            safepointPoll();
+            if (MessageNode *n = sleep()) {
+                Value v = n->value;
+                delete n;
+                return v;
+            }
+        }
+    }
+
+private:
+    // Blocks until a message arrives or the safepoint period passes; throws once nothing can send
+    MessageNode *sleep() {
+        IsolateRegistry &r = registry();
+        // 主程序不计入 blocked；它等待时若所有仍在运行的 isolate 都在等消息，就再也收不到消息
+        bool isolate = parent != nullptr;
+        bool orphaned = false;
+        {
+            std::lock_guard<std::mutex> guard(r.lock);
+            if (isolate) {
+                r.blocked++;
+                r.changed.notify_all();
+            } else {
+                orphaned = r.running == r.blocked;
+            }
+        }
+        MessageNode *n = nullptr;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            sleeping.store(true);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            // 持锁复查后再等待：send 看到 sleeping 时必须先拿到锁才能通知，唤醒不会丢失
+            n = queue.pop();
+            if (n == nullptr && !orphaned && !r.closing.load())
+                wakeup.wait_for(guard, std::chrono::milliseconds(SAFEPOINT_WAKE_MS));
+            sleeping.store(false);
+        }
+        if (isolate) {
+            std::lock_guard<std::mutex> guard(r.lock);
+            r.blocked--;
+        }
+        if (n == nullptr && (orphaned || r.closing.load())) {
+            n = queue.pop();
+            if (n == nullptr) throw RuntimeError("isolate-receive: no isolate can send any more messages");
+        }
+        return n;
+    }
+};
+
+static thread_local std::shared_ptr<IsolateState> current_isolate;
+
+static std::shared_ptr<IsolateState> &currentIsolate() {
+    if (!current_isolate) current_isolate = std::make_shared<IsolateState>();
+    return current_isolate;
+}
+
+Isolate::Isolate(const std::shared_ptr<IsolateState> &state) : ValueBase(V_ISOLATE), state(state) {}
+
+void Isolate::show(std::ostream &os) {
+    os << "#<isolate>";
+}
+
+void waitForIsolates() {
+    IsolateRegistry &r = registry();
+    std::unique_lock<std::mutex> guard(r.lock);
+    while (1) {
+        // 主程序已结束：所有仍在运行的 isolate 都在等消息时，再也不会有消息到达
+        r.changed.wait(guard, [&]() { return r.running == r.blocked; });
+        if (r.running > 0 && !r.closing.load()) {
+            r.closing.store(true);
+            for (auto &weak : r.states) {
+                std::shared_ptr<IsolateState> state = weak.lock();
+                if (!state) continue;
+                std::lock_guard<std::mutex> state_guard(state->lock);
+                state->wakeup.notify_one();
+            }
+        }
+        std::vector<std::thread> threads;
+        threads.swap(r.threads);
+        if (threads.empty() && r.running == 0) break;
+        guard.unlock();
+        for (auto &t : threads) t.join();
+        guard.lock();
+    }
+    r.states.clear();
+}
+
+static Value isolateValue(const std::shared_ptr<IsolateState> &state) {
+    countAllocation(V_ISOLATE, sizeof(Isolate));
+    return Value(new Isolate(state));
+}
+
+// Copies a message so that the receiver shares no objects with the sender
+static Value copyMessage(const Value &v, std::map<ValueBase *, Value> &copied) {
+    switch (v->v_type) {
+        case V_INT:
+            return IntegerV(static_cast<Integer*>(v.get())->n);
+        case V_RATIONAL:
+            return RationalV(static_cast<Rational*>(v.get())->numerator,
+                             static_cast<Rational*>(v.get())->denominator);
+        case V_BOOL:
+            return BooleanV(static_cast<Boolean*>(v.get())->b);
+        case V_SYM:
+            return SymbolV(static_cast<Symbol*>(v.get())->s);
+        case V_STRING:
+            return StringV(static_cast<String*>(v.get())->s);
+        case V_NULL:
+            return NullV();
+        case V_VOID:
+            return VoidV();
+        case V_ISOLATE:
+            return isolateValue(static_cast<Isolate*>(v.get())->state);
+        case V_PAIR: {
+            auto it = copied.find(v.get());
+            if (it != copied.end()) return it->second;
+            Pair *p = static_cast<Pair*>(v.get());
+            Value copy = PairV(NullV(), NullV());
+            copied.insert({v.get(), copy});
+            Pair *c = static_cast<Pair*>(copy.get());
+            c->car = copyMessage(p->car, copied);
+            c->cdr = copyMessage(p->cdr, copied);
+            return copy;
+        }
+        default:
+            throw RuntimeError("isolate-send!: value cannot be sent between isolates");
+    }
+}
+
+static void runIsolate(std::shared_ptr<IsolateState> self, std::string file) {
+    current_isolate = self;
+    {
+        OutputBuffer buffer(1, 64 * 1024);
+        std::ostream out(&buffer);
+        Interpreter interp;
+        interp.setOutput(&out);
+        std::ifstream in(file.c_str(), std::ios::binary);
+        ReplOptions opts;
+        opts.prompt = false;
+        interp.repl(in, opts);
+        out.flush();
+    }
+    current_isolate.reset();
+    IsolateRegistry &r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    r.running--;
+    r.changed.notify_all();
+}
+
+Value makeIsolatePrimitive(const std::vector<Value> &args) {
+    if (args[0]->v_type != V_STRING) {
+        throw RuntimeError("make-isolate: expected a file name string");
+    }
+    std::string file = static_cast<String*>(args[0].get())->s;
+    if (!std::ifstream(file.c_str())) {
+        throw RuntimeError("make-isolate: cannot open " + file);
+    }
+    std::shared_ptr<IsolateState> child = std::make_shared<IsolateState>();
+    child->parent = currentIsolate();
+    IsolateRegistry &r = registry();
+    {
+        std::lock_guard<std::mutex> guard(r.lock);
+        r.running++;
+        r.states.push_back(child);
+        r.threads.push_back(std::thread(runIsolate, child, file));
+    }
+    return isolateValue(child);
+}
+
+Value isolateSendPrimitive(const std::vector<Value> &args) {
+    if (args[0]->v_type != V_ISOLATE) {
+        throw RuntimeError("isolate-send!: expected an isolate");
+    }
+    std::map<ValueBase *, Value> copied;
+    static_cast<Isolate*>(args[0].get())->state->send(copyMessage(args[1], copied));
+    return VoidV();
+}
+
+Value isolateReceivePrimitive(const std::vector<Value> &args) {
+    (void)args;
+    return currentIsolate()->receive();
+}
+
+Value isolateParentPrimitive(const std::vector<Value> &args) {
+    (void)args;
+    std::shared_ptr<IsolateState> parent = currentIsolate()->parent;
+    if (!parent) return BooleanV(false);
+    return isolateValue(parent);
+}
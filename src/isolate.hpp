@@ -0,0 +1,56 @@
+#ifndef ISOLATE_HPP
+#define ISOLATE_HPP
+
+/**
+ * @file isolate.hpp
+ * @brief Isolates: interpreters on their own threads that share nothing
+ *
+ * An isolate runs a script on a dedicated OS thread with a fresh
+ * Interpreter, so it has its own global environment and no Value is ever
+ * reachable from two isolates. Messages are deep-copied by the sender and
+ * handed over through a lock-free multi-producer single-consumer queue;
+ * after the hand-off only the receiver touches the copy, so reference
+ * counts are never contended across threads.
+ *
+ *   (make-isolate "file.scm")   starts an isolate and returns its handle
+ *   (isolate-send! iso v)       copies v into iso's mailbox
+ *   (isolate-receive)           takes the next message for the current isolate
+ *   (isolate-parent)            handle of the creating isolate, #f in the main program
+ *
+ * Numbers, booleans, symbols, strings, lists (including cyclic ones),
+ * void and isolate handles can be sent; procedures, futures and channels
+ * cannot. An isolate writes its output through its own buffer to stdout.
+ *
+ * isolate-receive in the main program fails with a RuntimeError when its
+ * mailbox is empty and no isolate is left that could send: all of them
+ * have finished, or all still running are waiting for a message too.
+ *
+ * When the main program ends it waits for every isolate to finish its
+ * script. Once all isolates still running are waiting for a message,
+ * which can then never arrive, isolate-receive fails in each of them with
+ * a RuntimeError so that their scripts run to the end.
+ */
+
+#include "value.hpp"
+#include <vector>
+
+struct IsolateState;
+
+/**
+ * @brief Handle to an isolate's mailbox
+ */
+struct Isolate : ValueBase {
+    std::shared_ptr<IsolateState> state;
+    Isolate(const std::shared_ptr<IsolateState> &);
+    virtual void show(std::ostream &) override;
+};
+
+// Waits until every isolate thread has finished its script and joins it
+void waitForIsolates();
+
+Value makeIsolatePrimitive(const std::vector<Value> &args);
+Value isolateSendPrimitive(const std::vector<Value> &args);
+Value isolateReceivePrimitive(const std::vector<Value> &args);
+Value isolateParentPrimitive(const std::vector<Value> &args);
+
+#endif // ISOLATE_HPP
@@ -0,0 +1,83 @@
+/**
+ * @file jobs.cpp
+ * @brief Implementation of the multi-threaded script runner
+ */
+
+#include "jobs.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+namespace {
+
+struct JobResult {
+    bool done;
+    int errors;
+    std::string output;
+    JobResult() : done(false), errors(0) {}
+};
+
+} // namespace
+
+int runJobs(Interpreter &root, const std::vector<std::string> &scripts, int threads, std::ostream &out) {
+    // 会话在主线程中一次性 fork，工作线程只读共享的预加载环境
+    std::vector<Interpreter> sessions;
+    sessions.reserve(scripts.size());
+    for (size_t i = 0; i < scripts.size(); i++)
+        sessions.push_back(root.fork());
+
+    std::vector<JobResult> results(scripts.size());
+    std::atomic<size_t> next(0);
+    std::mutex lock;
+    std::condition_variable finished;
+
+    auto worker = [&]() {
+        ReplOptions opts;
+        opts.prompt = false;
+        while (1) {
+            size_t job = next.fetch_add(1);
+            if (job >= scripts.size()) break;
+            std::ostringstream output;
+            int errors = 0;
+            std::ifstream file(scripts[job].c_str(), std::ios::binary);
+            if (!file) {
+                output << "cannot open " << scripts[job] << '\n';
+                errors = 1;
+            } else {
+                sessions[job].setOutput(&output);
+                errors = sessions[job].repl(file, opts);
+            }
+            sessions[job] = Interpreter();  // 尽早释放该脚本的私有绑定
+            std::lock_guard<std::mutex> guard(lock);
+            results[job].output = output.str();
+            results[job].errors = errors;
+            results[job].done = true;
+            finished.notify_one();
+        }
+    };
+
+    if (threads < 1) threads = 1;
+    if ((size_t)threads > scripts.size()) threads = (int)scripts.size();
+    std::vector<std::thread> pool;
+    for (int i = 0; i < threads; i++)
+        pool.push_back(std::thread(worker));
+
+    // 按脚本顺序输出：等到第 k 个脚本完成再写出它的缓冲区
+    int errors = 0;
+    for (size_t k = 0; k < scripts.size(); k++) {
+        std::string text;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            finished.wait(guard, [&]() { return results[k].done; });
+            text.swap(results[k].output);
+            errors += results[k].errors;
+        }
+        out << text;
+    }
+    for (auto &t : pool) t.join();
+    out.flush();
+    return errors;
+}
@@ -0,0 +1,25 @@
+#ifndef JOBS_HPP
+#define JOBS_HPP
+
+/**
+ * @file jobs.hpp
+ * @brief Concurrent evaluation of independent scripts on a thread pool
+ *
+ * Each script runs in its own session forked from a shared root
+ * interpreter (see Interpreter::fork), so the parsed prelude code and its
+ * values are shared read-only between threads while every script gets
+ * private bindings and a private output buffer. A script that applies
+ * set-car! or set-cdr! to a pair built by the prelude gets a
+ * RuntimeError. Outputs are written in script order as soon as all
+ * earlier scripts have finished.
+ */
+
+#include "interpreter.hpp"
+#include <string>
+#include <vector>
+#include <ostream>
+
+// Runs every script on threads workers; returns the total number of RuntimeErrors
+int runJobs(Interpreter &root, const std::vector<std::string> &scripts, int threads, std::ostream &out);
+
+#endif // JOBS_HPP
@@ -0,0 +1,125 @@
+/**
+ * @file limits.cpp
+ * @brief Implementation of evaluation quotas
+ */
+
+#include "limits.hpp"
+#include "RE.hpp"
+#include <algorithm>
+
+static const unsigned long UNLIMITED = ~0UL;
+
+// Largest grant taken from a shared pool at once, beyond what is needed now
+static const unsigned long STEP_GRANT = 4096;
+static const unsigned long HEAP_GRANT = 256 * 1024;
+
+thread_local Budget eval_budget = {0, 0, 0, 0, 0, UNLIMITED, UNLIMITED, UNLIMITED, nullptr, false};
+
+static Limits default_limits;
+
+Limits::Limits() : max_steps(0), max_heap(0), max_depth(0), timeout_ms(0) {}
+
+void setDefaultLimits(const Limits &limits) {
+    default_limits = limits;
+}
+
+const Limits &defaultLimits() {
+    return default_limits;
+}
+
+static unsigned long effective(unsigned long limit) {
+    return limit == 0 ? UNLIMITED : limit;
+}
+
+RequestBudget::RequestBudget(const Limits &limits)
+    : max_steps(effective(limits.max_steps)), max_heap(effective(limits.max_heap)), depth_quota(limits.max_depth),
+      timeout_ms(limits.timeout_ms), deadline(std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms)),
+      steps(0), heap(0) {}
+
+unsigned long RequestBudget::remainingMs() const {
+    if (timeout_ms == 0) return 0;
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+    // 已过期的任务仍需装上超时，在第一个安全点失败
+    return left.count() < 1 ? 1 : (unsigned long)left.count();
+}
+
+// Takes need units plus a share of what is left from a pool, or fails if need does not fit
+static bool reserve(std::atomic<unsigned long> &used, unsigned long max, unsigned long need, unsigned long chunk,
+                    unsigned long &grant) {
+    unsigned long cur = used.load(std::memory_order_relaxed);
+    do {
+        if (cur > max || max - cur < need) return false;
+        // 余量越少每次取得越少，其他线程手中剩下的份额也随之变小
+        grant = need + std::min(chunk, (max - cur - need) / 4);
+    } while (!used.compare_exchange_weak(cur, cur + grant, std::memory_order_relaxed));
+    return true;
+}
+
+void refillSteps() {
+    Budget &b = eval_budget;
+    unsigned long grant;
+    if (b.shared == nullptr || !reserve(b.shared->steps, b.shared->max_steps, b.steps - b.max_steps, STEP_GRANT, grant))
+        throw RuntimeError("Step limit exceeded");
+    b.max_steps += grant;
+}
+
+void refillHeap() {
+    Budget &b = eval_budget;
+    unsigned long grant;
+    if (b.shared == nullptr || !reserve(b.shared->heap, b.shared->max_heap, b.heap - b.max_heap, HEAP_GRANT, grant))
+        throw RuntimeError("Heap limit exceeded");
+    b.max_heap += grant;
+}
+
+void depthLimitExceeded() {
+    throw RuntimeError("Recursion depth limit exceeded");
+}
+
+std::shared_ptr<RequestBudget> currentBudget() {
+    if (!eval_budget.active || eval_budget.shared == nullptr) return nullptr;
+    return eval_budget.shared->shared_from_this();
+}
+
+BudgetScope::BudgetScope(const Limits &limits)
+    : request(eval_budget.active ? nullptr : std::make_shared<RequestBudget>(limits)), saved(eval_budget),
+      owner(request != nullptr), safepoint(owner ? request->remainingMs() : 0) {
+    if (owner) install();
+}
+
+BudgetScope::BudgetScope(const std::shared_ptr<RequestBudget> &budget)
+    : request(budget ? budget : std::make_shared<RequestBudget>(Limits())), saved(eval_budget),
+      owner(!eval_budget.active || eval_budget.shared != request.get()),
+      safepoint(owner ? request->remainingMs() : 0) {
+    // 同一请求的任务在本线程内联执行时直接计入当前预算
+    if (owner) install();
+}
+
+void BudgetScope::install() {
+    Budget &b = eval_budget;
+    b.steps = 0;
+    b.heap = 0;
+    // 有限额时从 0 开始，第一次计数就向共享池领取
+    b.max_steps = request->max_steps == UNLIMITED ? UNLIMITED : 0;
+    b.max_heap = request->max_heap == UNLIMITED ? UNLIMITED : 0;
+    // 深度从当前嵌套层数起算
+    b.max_depth = request->depth_quota == 0 ? UNLIMITED : b.depth + request->depth_quota;
+    b.shared = request.get();
+    b.active = true;
+}
+
+BudgetScope::~BudgetScope() {
+    if (!owner) return;
+    Budget &b = eval_budget;
+    // 未用完的份额还给共享池，供仍在运行的任务使用
+    if (b.max_steps != UNLIMITED && b.max_steps > b.steps) request->steps.fetch_sub(b.max_steps - b.steps);
+    if (b.max_heap != UNLIMITED && b.max_heap > b.heap) request->heap.fetch_sub(b.max_heap - b.heap);
+    // 只恢复外层的配额与份额；applications 与 peak_depth 在嵌套期间继续累计
+    b.steps = saved.steps;
+    b.heap = saved.heap;
+    b.max_steps = saved.max_steps;
+    b.max_heap = saved.max_heap;
+    b.max_depth = saved.max_depth;
+    b.shared = saved.shared;
+    b.active = saved.active;
+    if (saved.peak_depth > b.peak_depth) b.peak_depth = saved.peak_depth;
+}
@@ -0,0 +1,129 @@
+#ifndef LIMITS_HPP
+#define LIMITS_HPP
+
+/**
+ * @file limits.hpp
+ * @brief Step, heap and depth quotas of one evaluation
+ *
+ * Every top-level form of the REPL and every Interpreter::eval or call
+ * runs against a fresh budget taken from the interpreter's Limits; a
+ * worker request is one eval, so each request gets its own quota. A
+ * step is a procedure application or an expression of a body, heap is
+ * the number of bytes allocated for values and environment frames
+ * (released memory is not given back), and depth is the nesting of
+ * procedure applications. Exceeding any of them throws RuntimeError.
+ * The wall-clock timeout is enforced through safepoints (safepoint.hpp).
+ *
+ * The counters live in a thread-local Budget. Evaluations started while
+ * a budget is active (nested calls, parallel tasks run inline) count
+ * against it. Tasks run on other threads join the RequestBudget of the
+ * evaluation that spawned them: steps and heap are drawn from one shared
+ * pool, in grants that shrink as the pool runs out, so a request never
+ * exceeds its quota however far it fans out, and every task stops at the
+ * request's deadline. Depth stays per thread, counted from where the task
+ * started.
+ */
+
+#include "safepoint.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+
+/**
+ * @brief Quotas of one evaluation, 0 meaning unlimited
+ */
+struct Limits {
+    unsigned long max_steps;
+    unsigned long max_heap;    ///< Bytes
+    unsigned long max_depth;
+    unsigned long timeout_ms;  ///< Wall-clock time, enforced at safepoints
+    Limits();
+};
+
+// Limits of interpreters created from now on (set from the command line)
+void setDefaultLimits(const Limits &);
+const Limits &defaultLimits();
+
+/**
+ * @brief Quotas shared by every thread working on one evaluation
+ */
+struct RequestBudget : std::enable_shared_from_this<RequestBudget> {
+    unsigned long max_steps;   ///< ~0UL when unlimited
+    unsigned long max_heap;
+    unsigned long depth_quota; ///< max_depth as given, relative to the depth each thread starts at
+    unsigned long timeout_ms;
+    std::chrono::steady_clock::time_point deadline;
+    std::atomic<unsigned long> steps;   ///< Granted to threads so far
+    std::atomic<unsigned long> heap;
+    explicit RequestBudget(const Limits &);
+    unsigned long remainingMs() const;  ///< Time left before the deadline, at least 1; 0 without a timeout
+};
+
+/**
+ * @brief Counters of the evaluation running on this thread
+ */
+struct Budget {
+    unsigned long steps;
+    unsigned long heap;
+    unsigned long depth;
+    unsigned long applications; ///< Procedure applications on this thread, never reset
+    unsigned long peak_depth;  ///< Deepest depth since the last reset by (time ...)
+    unsigned long max_steps;   ///< End of the steps granted to this thread, ~0UL when unlimited
+    unsigned long max_heap;
+    unsigned long max_depth;
+    RequestBudget *shared;     ///< Owned by the BudgetScope that installed it
+    bool active;
+};
+
+extern thread_local Budget eval_budget;
+
+// Take a further grant from the shared pool, or throw when it is used up
+void refillSteps();
+void refillHeap();
+[[noreturn]] void depthLimitExceeded();
+
+inline void chargeStep() {
+    if (++eval_budget.steps > eval_budget.max_steps) refillSteps();
+}
+
+inline void chargeHeap(size_t bytes) {
+    if ((eval_budget.heap += bytes) > eval_budget.max_heap) refillHeap();
+}
+
+// Budget that tasks spawned from this thread should join (null when none is active)
+std::shared_ptr<RequestBudget> currentBudget();
+
+/**
+ * @brief Installs a budget unless this thread already works on the same evaluation
+ */
+class BudgetScope {
+public:
+    explicit BudgetScope(const Limits &);                           ///< Starts a new evaluation
+    explicit BudgetScope(const std::shared_ptr<RequestBudget> &);   ///< Joins the evaluation of a task
+    ~BudgetScope();
+private:
+    void install();
+    std::shared_ptr<RequestBudget> request;
+    Budget saved;
+    bool owner;
+    SafepointScope safepoint;
+};
+
+/**
+ * @brief Counts one level of procedure application
+ */
+struct DepthGuard {
+    DepthGuard() {
+        Budget &b = eval_budget;
+        b.applications++;
+        if (++b.depth > b.peak_depth) b.peak_depth = b.depth;
+        if (b.depth > b.max_depth) {
+            --b.depth;
+            depthLimitExceeded();
+        }
+    }
+    ~DepthGuard() { --eval_budget.depth; }
+};
+
+#endif // LIMITS_HPP
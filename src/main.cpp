@@ -1,150 +1,278 @@
+/**
+ * @file main.cpp
+ * @brief Command line front end of the Scheme interpreter
+ */
 
-#include "Def.hpp"
-#include "syntax.hpp"
-#include "expr.hpp"
-#include "value.hpp"
-#include "RE.hpp"
+#include "interpreter.hpp"
+#include "worker.hpp"
+#include "jobs.hpp"
+#include "scheduler.hpp"
+#include "isolate.hpp"
+#include "purity.hpp"
+#include "safepoint.hpp"
+#include "profile.hpp"
+#include "allocation.hpp"
+#include "perf.hpp"
+#include "histogram.hpp"
+#include "envstats.hpp"
+#include "trace.hpp"
 #include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
 #include <iostream>
-#include <map>
-
-extern std::map<std::string, ExprType> primitives;
-extern std::map<std::string, ExprType> reserved_words;
 
-// 检查表达式是否是显式的 void 调用或在允许的嵌套结构中
-bool isExplicitVoidCall(Expr expr) {
-    // 检查是否是直接的 MakeVoid (即 (void))
-    MakeVoid* make_void_expr = dynamic_cast<MakeVoid*>(expr.get());
-    if (make_void_expr != nullptr) {
-        return true;
-    }
+// Waits for the isolates, then closes the trace and writes the profiles, statistics and
+// histogram if asked for
+static int finish(int status) {
+    waitForIsolates();
+    stopTracing(std::cerr);
+    if (profilingEnabled())
+        reportProfiles(std::cerr);
+    if (allocationReportEnabled())
+        printAllocationStats(std::cerr);
+    printEnvStats(std::cerr);
+    writeExprHistogram(std::cerr);
+    return status;
+}
 
-    // 检查是否是 Apply 表达式调用 void
-    Apply* apply_expr = dynamic_cast<Apply*>(expr.get());
-    if (apply_expr != nullptr) {
-        Var* var_expr = dynamic_cast<Var*>(apply_expr->rator.get());
-        if (var_expr != nullptr && var_expr->x == "void") {
-            return true;
-        }
-    }
+static void usage(const char *prog) {
+    std::cerr << "usage: " << prog << " [options] [script.scm [args...]]\n"
+              << "  -e EXPR                    evaluate EXPR (may be repeated)\n"
+              << "  --stream                   read stdin as an unbounded batch stream\n"
+              << "  --window BYTES             size of the input read window\n"
+              << "  --max-form-bytes BYTES     largest accepted top-level form (0: no limit)\n"
+              << "  --max-pending-defines N    evaluate a define group after N defines (--stream: 256)\n"
+              << "  --output-buffer BYTES      size of the batch output buffer\n"
+              << "  --worker                   serve framed requests on stdin/stdout after the prelude\n"
+              << "  --socket PATH              serve framed requests on a Unix domain socket\n"
+              << "  --jobs N                   run every script argument on N threads, -e forms are a shared prelude\n"
+              << "  --threads N                threads used by parallel-map and friends (default: all cores)\n"
+              << "  --max-steps N              abort a form or request after N evaluation steps\n"
+              << "  --max-heap BYTES           abort a form or request after allocating BYTES\n"
+              << "  --max-depth N              abort a form or request nested N procedure calls deep\n"
+              << "  --timeout SECONDS          abort a form or request after SECONDS of wall-clock time\n"
+              << "  --parallel-args            evaluate expensive pure call operands in parallel\n"
+              << "  --parallel-args-cost N     smallest estimated operand cost worth a task (default 256)\n"
+              << "  --profile                  print call counts and times per procedure to stderr at exit\n"
+              << "  --sample FILE              sample the Scheme call stack, write folded stacks to FILE at exit\n"
+              << "  --sample-rate N            samples per second of CPU time (default 1000)\n"
+              << "  --alloc-stats              print objects and bytes allocated per kind to stderr at exit\n"
+              << "  --perf-counters            print hardware counter deltas of every top-level form to stderr\n"
+              << "  --env-stats                print environment lookup hops per walk and per variable to stderr at exit\n"
+              << "  --expr-histogram FILE      count evaluations per expression type and node, write CSV (or .json) at exit\n"
+              << "  --trace FILE               write top-level forms and slow procedure calls as Chrome trace events\n"
+              << "  --trace-threshold-us N     shortest procedure call recorded by --trace (default 100, 0: all)\n"
+              << "  --image FILE               start from a heap image written by (save-image FILE)\n";
+}
 
-    // 检查是否是 begin 表达式，且最后一个表达式是 void 调用
-    Begin* begin_expr = dynamic_cast<Begin*>(expr.get());
-    if (begin_expr != nullptr && !begin_expr->es.empty()) {
-        return isExplicitVoidCall(begin_expr->es.back());
-    }
+int main(int argc, char *argv[]) {
+    ReplOptions opts;
+    bool stream = false;
+    size_t window_bytes = 64 * 1024;
+    size_t max_form_bytes = 1024 * 1024;
+    size_t output_bytes = 1024 * 1024;
+    std::vector<std::string> exprs;
+    const char *script = nullptr;
+    const char *image = nullptr;
+    bool worker = false;
+    int jobs = 0;
+    Limits limits;
+    bool parallel_args = false;
+    unsigned long parallel_args_cost = 256;
+    const char *socket_path = nullptr;
+    const char *sample_path = nullptr;
+    unsigned sample_rate = 1000;
+    const char *trace_path = nullptr;
+    unsigned long trace_threshold_us = 100;
 
-    // 检查是否是 if 表达式的分支包含显式 void 调用
-    If* if_expr = dynamic_cast<If*>(expr.get());
-    if (if_expr != nullptr) {
-        return isExplicitVoidCall(if_expr->conseq) || isExplicitVoidCall(if_expr->alter);
+    int i = 1;
+    for (; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--stream") {
+            stream = true;
+        } else if (arg == "-e" && i + 1 < argc) {
+            exprs.push_back(argv[++i]);
+        } else if (arg == "--window" && i + 1 < argc) {
+            window_bytes = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--max-form-bytes" && i + 1 < argc) {
+            max_form_bytes = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--max-pending-defines" && i + 1 < argc) {
+            opts.max_pending_defines = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--output-buffer" && i + 1 < argc) {
+            output_bytes = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--jobs" && i + 1 < argc) {
+            jobs = std::atoi(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            Scheduler::configure(std::atoi(argv[++i]));
+        } else if (arg == "--max-steps" && i + 1 < argc) {
+            limits.max_steps = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--max-heap" && i + 1 < argc) {
+            limits.max_heap = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--max-depth" && i + 1 < argc) {
+            limits.max_depth = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--timeout" && i + 1 < argc) {
+            limits.timeout_ms = (unsigned long)(std::strtod(argv[++i], nullptr) * 1000);
+        } else if (arg == "--parallel-args") {
+            parallel_args = true;
+        } else if (arg == "--parallel-args-cost" && i + 1 < argc) {
+            parallel_args_cost = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--profile") {
+            enableProfiling();
+        } else if (arg == "--alloc-stats") {
+            enableAllocationReport();
+        } else if (arg == "--perf-counters") {
+            enablePerfCounters();
+        } else if (arg == "--trace" && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (arg == "--trace-threshold-us" && i + 1 < argc) {
+            trace_threshold_us = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--env-stats") {
+            enableEnvStats();
+        } else if (arg == "--expr-histogram" && i + 1 < argc) {
+            enableExprHistogram(argv[++i]);
+        } else if (arg == "--sample" && i + 1 < argc) {
+            sample_path = argv[++i];
+        } else if (arg == "--sample-rate" && i + 1 < argc) {
+            sample_rate = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--worker") {
+            worker = true;
+        } else if (arg == "--socket" && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (arg == "--image" && i + 1 < argc) {
+            image = argv[++i];
+        } else if (arg == "--") {
+            i++;
+            break;
+        } else if (!arg.empty() && arg[0] == '-' && arg != "-") {
+            usage(argv[0]);
+            return 2;
+        } else {
+            break;
+        }
     }
-
-    // 检查是否是 cond 表达式的某个分支包含显式 void 调用
-    Cond* cond_expr = dynamic_cast<Cond*>(expr.get());
-    if (cond_expr != nullptr) {
-        for (const auto& clause : cond_expr->clauses) {
-            if (clause.size() > 1 && isExplicitVoidCall(clause.back())) {
-                return true;
-            }
+    if (i < argc) {
+        script = argv[i];
+        for (; i < argc; i++) {
+            commandLine().push_back(argv[i]);
         }
     }
 
-    return false;
-}
-
-/**
- * @brief Batch processing of multiple define statements supporting mutual recursion
- */
-Value evaluateDefineGroup(const std::vector<std::pair<std::string, Expr>>& defines, Assoc &env) {
-    // 第一阶段：为所有变量创建占位符绑定
-    for (const auto& def : defines) {
-        if (primitives.count(def.first) || reserved_words.count(def.first)) {
-            throw RuntimeError("Cannot redefine primitive: " + def.first);
+    configureParallelArgs(parallel_args, parallel_args_cost);
+    setDefaultLimits(limits);
+    installSafepointSignals();
+    if (sample_path != nullptr)
+        startSampling(sample_path, sample_rate);
+    if (trace_path != nullptr && !startTracing(trace_path, trace_threshold_us)) {
+        std::cerr << argv[0] << ": cannot open " << trace_path << ": " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+    Interpreter interp;
+    if (image != nullptr) {
+        try {
+            interp.loadImage(image);
+        } catch (const RuntimeError &err) {
+            std::cerr << argv[0] << ": " << err.message() << std::endl;
+            return 1;
         }
-        env = extend(def.first, Value(nullptr), env);
     }
-
-    // 第二阶段：求值所有表达式并更新绑定
-    Value last_result = VoidV();
-    for (const auto& def : defines) {
-        Value val = def.second->eval(env);
-        modify(def.first, val, env);
-        last_result = VoidV(); // define 总是返回 void
+    bool serving = worker || socket_path != nullptr;
+    bool interactive = !serving && jobs == 0 && !stream && exprs.empty() && script == nullptr;
+    if (interactive) {
+        // 交互模式：只使用 std::cout，不再与 stdio 同步
+        std::ios::sync_with_stdio(false);
+        interp.repl(std::cin, opts);
+        return finish(0);
     }
 
-    return last_result;
-}
-
-void REPL(){
-    // read - evaluation - print loop with define grouping
-    Assoc global_env = empty();
-    std::vector<std::pair<std::string, Expr>> pending_defines;
-
-    while (1){
-        #ifndef ONLINE_JUDGE
-            std::cout << "scm> ";
-        #endif
-        Syntax stx = readSyntax(std::cin); // read
-        try{
-            Expr expr = stx->parse(global_env); // parse
-
-            // 检查是否是 define 表达式
-            Define* define_expr = dynamic_cast<Define*>(expr.get());
-            if (define_expr != nullptr) {
-                // 收集 define 表达式
-                pending_defines.push_back({define_expr->var, define_expr->e});
-                // 不立即求值，继续读取下一个表达式
-                continue;
-            } else {
-                // 不是 define 表达式
-                // 如果有待处理的 define，先批量处理它们
-                if (!pending_defines.empty()) {
-                    evaluateDefineGroup(pending_defines, global_env);
-                    pending_defines.clear();
-                }
-
-                // 处理当前的非 define 表达式
-                Value val = expr->eval(global_env);
-                if (val->v_type == V_TERMINATE)
-                    break;
-
-                // 简化的显示逻辑：
-                // 如果结果是 void，只有在显式调用 (void) 或在允许的嵌套结构中时才显示
-                if (val->v_type == V_VOID) {
-                    if (isExplicitVoidCall(expr)) {
-                        val->show(std::cout);
-                        puts("");
-                    }
-                    // 其他返回 void 的表达式不输出任何内容
-                } else {
-                    // 非 void 结果正常显示
-                    val->show(std::cout);
-                    puts("");
-                }
+    if (serving) {
+        // 工作进程模式：-e 与脚本作为预加载部分只求值一次，其输出写到 stderr，stdout 只留给响应帧
+        std::ios::sync_with_stdio(false);
+        interp.setOutput(&std::cerr);
+        opts.prompt = false;
+        int errors = 0;
+        for (const auto &text : exprs) {
+            std::istringstream in(text);
+            errors += interp.repl(in, opts);
+        }
+        if (script != nullptr) {
+            int fd = std::string(script) == "-" ? 0 : open(script, O_RDONLY);
+            if (fd < 0) {
+                std::cerr << argv[0] << ": cannot open " << script << ": " << std::strerror(errno) << std::endl;
+                return 1;
             }
+            InputWindow window(fd, window_bytes == 0 ? 1 : window_bytes, max_form_bytes);
+            std::istream in(&window);
+            opts.window = &window;
+            errors += interp.repl(in, opts);
+            opts.window = nullptr;
+            if (fd != 0)
+                close(fd);
         }
-        catch (const RuntimeError &RE){
-            // 如果出错，清空待处理的 define
-            pending_defines.clear();
-            std::cout << "RuntimeError";
-            puts("");
+        interp.setOutput(nullptr);
+        if (errors != 0) {
+            std::cerr << argv[0] << ": prelude failed" << std::endl;
+            return 1;
         }
+        if (socket_path != nullptr)
+            return finish(serveSocket(interp, socket_path, max_form_bytes));
+        return finish(serveFrames(interp, 0, 1, max_form_bytes));
     }
 
-    // 如果程序结束时还有待处理的 define，处理它们
-    if (!pending_defines.empty()) {
-        try {
-            evaluateDefineGroup(pending_defines, global_env);
-        } catch (const RuntimeError &RE) {
-            std::cout << "RuntimeError in final defines";
-            puts("");
+    if (jobs > 0) {
+        // 多线程模式：-e 作为共享的预加载部分只求值一次，每个脚本在自己的会话中运行
+        std::ios::sync_with_stdio(false);
+        opts.prompt = false;
+        int errors = 0;
+        for (const auto &text : exprs) {
+            std::istringstream in(text);
+            errors += interp.repl(in, opts);
         }
+        OutputBuffer output(1, output_bytes == 0 ? 1 : output_bytes);
+        std::ostream out(&output);
+        errors += runJobs(interp, commandLine(), jobs, out);
+        out.flush();
+        return finish(errors == 0 ? 0 : 1);
     }
-}
 
+    // 批处理模式：无提示符，输出写入一个大缓冲区，退出或 (flush-output) 时写出
+    OutputBuffer output(1, output_bytes == 0 ? 1 : output_bytes);
+    std::ostream out(&output);
+    setOutputStream(&out);
+    opts.prompt = false;
+    if (stream) {
+        opts.reuse_bindings = true;
+        if (opts.max_pending_defines == 0)
+            opts.max_pending_defines = 256;
+    }
 
-int main(int argc, char *argv[]) {
-    REPL();
-    return 0;
+    int errors = 0;
+    for (const auto &text : exprs) {
+        std::istringstream in(text);
+        errors += interp.repl(in, opts);
+    }
+    if (script != nullptr || stream) {
+        int fd = 0;
+        if (script != nullptr && std::string(script) != "-") {
+            fd = open(script, O_RDONLY);
+            if (fd < 0) {
+                out.flush();
+                std::cerr << argv[0] << ": cannot open " << script << ": " << std::strerror(errno) << std::endl;
+                setOutputStream(nullptr);
+                return 1;
+            }
+        }
+        InputWindow window(fd, window_bytes == 0 ? 1 : window_bytes, max_form_bytes);
+        std::istream in(&window);
+        opts.window = &window;
+        errors += interp.repl(in, opts);
+        opts.window = nullptr;
+        if (fd != 0)
+            close(fd);
+    }
+    out.flush();
+    setOutputStream(nullptr);
+    return finish(errors == 0 ? 0 : 1);
 }
@@ -0,0 +1,213 @@
+/**
+ * @file parallel.cpp
+ * @brief Implementation of parallel-map, parallel-for-each and parallel-reduce
+ */
+
+#include "parallel.hpp"
+#include "scheduler.hpp"
+#include "RE.hpp"
+#include "io.hpp"
+#include "limits.hpp"
+#include "green.hpp"
+#include <algorithm>
+#include <sstream>
+
+namespace {
+
+enum ParallelKind {
+    PARALLEL_MAP,
+    PARALLEL_FOR_EACH,
+    PARALLEL_REDUCE
+};
+
+const char *kindName(ParallelKind kind) {
+    switch (kind) {
+        case PARALLEL_MAP:      return "parallel-map";
+        case PARALLEL_FOR_EACH: return "parallel-for-each";
+        default:                return "parallel-reduce";
+    }
+}
+
+/**
+ * @brief State shared by all ranges of one parallel call
+ */
+struct ParallelJob {
+    ParallelKind kind;
+    Value proc;
+    std::vector<Value> items;
+    std::vector<Value> results;                          ///< parallel-map only
+    size_t grain;                                        ///< Smallest range worth splitting
+    std::shared_ptr<EnvOverlay> overlay;                 ///< Snapshot of the caller's bindings, copied by each range
+    std::shared_ptr<RequestBudget> budget;               ///< Caller's quotas, shared by all ranges
+    std::atomic<size_t> remaining;                       ///< Items not yet accounted for
+    std::atomic<bool> cancelled;
+
+    std::mutex lock;                                     ///< Guards the fields below
+    std::vector<std::pair<size_t, std::string>> output;  ///< Range start, buffered output
+    std::vector<std::pair<size_t, Value>> partials;      ///< Range start, reduced value
+    bool failed;
+    size_t error_index;
+    std::string error;
+
+    ParallelJob(ParallelKind kind, const Value &proc)
+        : kind(kind), proc(proc), grain(1), budget(currentBudget()),
+          remaining(0), cancelled(false), failed(false), error_index(0) {}
+
+    void fail(size_t index, const std::string &message) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!failed || index < error_index) {
+            failed = true;
+            error_index = index;
+            error = message;
+        }
+        cancelled = true;
+    }
+};
+
+struct RangeTask : Scheduler::Task {
+    std::shared_ptr<ParallelJob> job;
+    size_t lo;
+    size_t hi;
+    RangeTask(const std::shared_ptr<ParallelJob> &job, size_t lo, size_t hi) : job(job), lo(lo), hi(hi) {}
+    virtual void run() override;
+};
+
+void RangeTask::run() {
+    Scheduler &scheduler = Scheduler::instance();
+    ParallelJob &j = *job;
+
+    BudgetScope scope(j.budget);
+
+    // 每个区间在调用方快照的私有副本上求值，set! 不会并发写同一张表；输出先写入本区间的缓冲区
+    std::ostringstream buffer;
+    std::ostream *saved_output = &outputStream();
+    std::shared_ptr<EnvOverlay> saved_overlay = activeOverlay();
+    setOutputStream(&buffer);
+    std::shared_ptr<EnvOverlay> overlay = copyOverlay(*j.overlay);
+    setActiveOverlay(overlay);
+
+    Value acc(nullptr);
+    size_t i = lo;
+    while (i < hi) {
+        // 惰性二分：自己的队列空了说明别的线程可能在等活，拆出后一半供其窃取
+        if (hi - i > 2 * j.grain && scheduler.localQueueEmpty()) {
+            size_t mid = i + (hi - i) / 2;
+            scheduler.spawn(std::make_shared<RangeTask>(job, mid, hi));
+            hi = mid;
+            continue;
+        }
+        if (!j.cancelled) {
+            try {
+                if (j.kind == PARALLEL_REDUCE) {
+                    acc = acc.get() == nullptr ? j.items[i] : applyProcedure(j.proc, {acc, j.items[i]});
+                } else {
+                    Value v = applyProcedure(j.proc, {j.items[i]});
+                    if (j.kind == PARALLEL_MAP) j.results[i] = v;
+                }
+                // 各区间的写入互不可见，合并回去只会留下某一个区间的结果
+                if (!overlay->written.empty())
+                    j.fail(i, std::string(kindName(j.kind)) + ": proc set! a variable defined outside it");
+            } catch (const RuntimeError &err) {
+                j.fail(i, err.message());
+            } catch (const std::exception &err) {
+                j.fail(i, err.what());
+            } catch (...) {
+                j.fail(i, "parallel: unknown error");
+            }
+        }
+        i++;
+    }
+    greenRunAll();
+
+    setOutputStream(saved_output);
+    setActiveOverlay(saved_overlay);
+    {
+        std::lock_guard<std::mutex> guard(j.lock);
+        std::string text = buffer.str();
+        if (!text.empty()) j.output.push_back({lo, text});
+        if (acc.get() != nullptr) j.partials.push_back({lo, acc});
+    }
+    j.remaining.fetch_sub(hi - lo);
+}
+
+std::vector<Value> listItems(const Value &list, const char *who) {
+    std::vector<Value> items;
+    Value cur = list;
+    while (cur->v_type == V_PAIR) {
+        Pair *p = static_cast<Pair*>(cur.get());
+        items.push_back(p->car);
+        cur = p->cdr;
+    }
+    if (cur->v_type != V_NULL) {
+        throw RuntimeError(std::string(who) + ": expected a list");
+    }
+    return items;
+}
+
+// Runs job over all of its items and returns once every range has finished
+void runParallel(const std::shared_ptr<ParallelJob> &job) {
+    Scheduler &scheduler = Scheduler::instance();
+    size_t n = job->items.size();
+    if (job->proc->v_type != V_PROC && job->proc->v_type != V_PRIMITIVE) {
+        throw RuntimeError("Attempt to apply a non-procedure");
+    }
+    if (job->kind == PARALLEL_MAP) job->results.assign(n, Value(nullptr));
+    job->grain = std::max<size_t>(1, n / (8 * (size_t)scheduler.threads()));
+    job->remaining = n;
+    if (n == 0) return;
+
+    // 冻结此刻的全部绑定：调用方在 helpUntil 中不会再写它们，各区间只读共享快照
+    unsigned long generation = freezeEnvironments();
+    std::shared_ptr<EnvOverlay> caller = activeOverlay();
+    job->overlay = caller ? std::make_shared<EnvOverlay>(*caller) : std::make_shared<EnvOverlay>(generation, 0);
+    job->overlay->frozen = generation;
+
+    RangeTask(job, 0, n).run();
+    scheduler.helpUntil([&]() { return job->remaining.load() == 0; });
+
+    std::sort(job->output.begin(), job->output.end(),
+              [](const std::pair<size_t, std::string> &a, const std::pair<size_t, std::string> &b) {
+                  return a.first < b.first;
+              });
+    std::ostream &out = outputStream();
+    for (auto &piece : job->output) out << piece.second;
+    if (job->failed) {
+        throw RuntimeError(job->error);
+    }
+}
+
+} // namespace
+
+Value parallelMapPrimitive(const std::vector<Value> &args) {
+    std::shared_ptr<ParallelJob> job = std::make_shared<ParallelJob>(PARALLEL_MAP, args[0]);
+    job->items = listItems(args[1], "parallel-map");
+    runParallel(job);
+    Value result = NullV();
+    for (size_t i = job->results.size(); i > 0; i--) {
+        result = PairV(job->results[i - 1], result);
+    }
+    return result;
+}
+
+Value parallelForEachPrimitive(const std::vector<Value> &args) {
+    std::shared_ptr<ParallelJob> job = std::make_shared<ParallelJob>(PARALLEL_FOR_EACH, args[0]);
+    job->items = listItems(args[1], "parallel-for-each");
+    runParallel(job);
+    return VoidV();
+}
+
+Value parallelReducePrimitive(const std::vector<Value> &args) {
+    std::shared_ptr<ParallelJob> job = std::make_shared<ParallelJob>(PARALLEL_REDUCE, args[0]);
+    job->items = listItems(args[2], "parallel-reduce");
+    runParallel(job);
+    // 各区间的部分结果按原顺序合并，proc 只需满足结合律
+    std::sort(job->partials.begin(), job->partials.end(),
+              [](const std::pair<size_t, Value> &a, const std::pair<size_t, Value> &b) {
+                  return a.first < b.first;
+              });
+    Value acc = args[1];
+    for (auto &part : job->partials) {
+        acc = applyProcedure(job->proc, {acc, part.second});
+    }
+    return acc;
+}
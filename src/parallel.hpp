@@ -0,0 +1,32 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+/**
+ * @file parallel.hpp
+ * @brief Data-parallel list primitives run on the work-stealing scheduler
+ *
+ *   (parallel-map proc list)          list of (proc item), in list order
+ *   (parallel-for-each proc list)     calls proc on every item, returns void
+ *   (parallel-reduce proc init list)  folds list with an associative proc
+ *
+ * The list is split into ranges lazily: a thread keeps halving its range
+ * while its own deque is empty, so chunks stay large when every thread is
+ * busy and get smaller when threads go idle and start stealing. Output of
+ * each range is buffered and appended in list order. The RuntimeError of
+ * the earliest failing item is rethrown in the caller.
+ *
+ * Each range runs against its own copy-on-write view of the bindings that
+ * existed when the call started. Ranges cannot see each other's writes,
+ * so a set! of such a binding inside proc fails the item with a
+ * RuntimeError; accumulate with parallel-reduce instead. Pairs are
+ * shared: proc must not set-car!/set-cdr! data other items use.
+ */
+
+#include "value.hpp"
+#include <vector>
+
+Value parallelMapPrimitive(const std::vector<Value> &args);
+Value parallelForEachPrimitive(const std::vector<Value> &args);
+Value parallelReducePrimitive(const std::vector<Value> &args);
+
+#endif // PARALLEL_HPP
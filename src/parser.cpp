@@ -12,6 +12,7 @@
 #include "syntax.hpp"
 #include "value.hpp"
 #include "expr.hpp"
+#include "profile.hpp"
 #include <map>
 #include <string>
 #include <iostream>
@@ -21,8 +22,17 @@ using std::string;
 using std::vector;
 using std::pair;
 
-extern std::map<std::string, ExprType> primitives;
-extern std::map<std::string, ExprType> reserved_words;
+extern const std::map<std::string, ExprType> primitives;
+extern const std::map<std::string, ExprType> reserved_words;
+
+/**
+ * @brief Labels a lambda bound to name by define, let or letrec (see profile.hpp)
+ */
+static void nameLambda(const Expr &expr, const Syntax &stx, const string &name) {
+    if (expr->e_type != E_LAMBDA) return;
+    List *source = dynamic_cast<List*>(stx.get());
+    static_cast<Lambda*>(expr.get())->label = procedureLabel(name, source != nullptr ? source->line : 0);
+}
 
 /**
  * @brief Default parse method (should be overridden by subclasses)
@@ -55,7 +65,21 @@ Expr FalseSyntax::parse(Assoc &env) {
     return Expr(new False());
 }
 
+/**
+ * @brief Parses the list with parse_line set to its line, so nodes know where they came from
+ */
 Expr List::parse(Assoc &env) {
+    struct LineScope {
+        int saved;
+        LineScope(int line) : saved(parse_line) {
+            if (line != 0) parse_line = line;
+        }
+        ~LineScope() { parse_line = saved; }
+    } scope(line);
+    return parseForm(env);
+}
+
+Expr List::parseForm(Assoc &env) {
     if (stxs.empty()) {
         return Expr(new Quote(Syntax(new List())));
     }
@@ -86,7 +110,7 @@ Expr List::parse(Assoc &env) {
         }
 
         // 特殊处理多参数算术运算符
-        ExprType op_type = primitives[op];
+        ExprType op_type = primitives.at(op);
         if (op_type == E_PLUS) {
             if (parameters.size() == 0) {
                 return Expr(new PlusVar(parameters)); // (+ ) → 0
@@ -192,7 +216,7 @@ Expr List::parse(Assoc &env) {
     }
 
     if (reserved_words.count(op) != 0) {
-    	switch (reserved_words[op]) {
+    	switch (reserved_words.at(op)) {
 			case E_BEGIN:{
              	vector<Expr> passed_exprs;
     		    for (size_t i = 1; i < stxs.size(); i++) {
@@ -231,7 +255,8 @@ Expr List::parse(Assoc &env) {
                 List* paras_ptr = dynamic_cast<List*>(stxs[1].get());
                 if (paras_ptr == nullptr) {throw RuntimeError("Invalid lambda parameter list");}
             	for (int i = 0; i < paras_ptr->stxs.size(); i++) {
-                    if (auto tmp_var = dynamic_cast<Var*>(paras_ptr->stxs[i].get()->parse(env).get())) {
+                    Expr para = paras_ptr->stxs[i].get()->parse(env); // 保持临时表达式存活
+                    if (auto tmp_var = dynamic_cast<Var*>(para.get())) {
                         vars.push_back(tmp_var->x);
                         New_env = extend(tmp_var->x, NullV(), New_env);
                     } else {
@@ -242,14 +267,14 @@ Expr List::parse(Assoc &env) {
                 // 处理多个body表达式
                 if (stxs.size() == 3) {
                 	// 单个body表达式
-                	return Expr(new Lambda(vars, stxs[2].get()->parse(New_env)));
+                	return Expr(new Lambda(vars, stxs[2].get()->parse(New_env), procedureLabel("", line)));
                 } else {
                 	// 多个body表达式，包装在Begin中
                 	vector<Expr> body_exprs;
                 	for (size_t i = 2; i < stxs.size(); i++) {
                 		body_exprs.push_back(stxs[i]->parse(New_env));
                 	}
-                	return Expr(new Lambda(vars, Expr(new Begin(body_exprs))));
+                	return Expr(new Lambda(vars, Expr(new Begin(body_exprs)), procedureLabel("", line)));
                 }
         	}
 			case E_DEFINE:{
@@ -282,7 +307,7 @@ Expr List::parse(Assoc &env) {
 					// 创建lambda表达式，支持多个body表达式
 					if (stxs.size() == 3) {
 						// 单个body表达式
-						Expr lambda_expr = Expr(new Lambda(param_names, stxs[2]->parse(env)));
+						Expr lambda_expr = Expr(new Lambda(param_names, stxs[2]->parse(env), procedureLabel(func_name->s, line)));
 						return Expr(new Define(func_name->s, lambda_expr));
 					} else {
 						// 多个body表达式，包装在Begin中
@@ -290,7 +315,7 @@ Expr List::parse(Assoc &env) {
 						for (size_t i = 2; i < stxs.size(); i++) {
 							body_exprs.push_back(stxs[i]->parse(env));
 						}
-						Expr lambda_expr = Expr(new Lambda(param_names, Expr(new Begin(body_exprs))));
+						Expr lambda_expr = Expr(new Lambda(param_names, Expr(new Begin(body_exprs)), procedureLabel(func_name->s, line)));
 						return Expr(new Define(func_name->s, lambda_expr));
 					}
 				} else {
@@ -298,7 +323,9 @@ Expr List::parse(Assoc &env) {
 					if (stxs.size() != 3) throw RuntimeError("wrong parameter number for simple define");
 					SymbolSyntax *var_id = dynamic_cast<SymbolSyntax*>(stxs[1].get());
 					if (var_id == nullptr) {throw RuntimeError("Invalid define variable");}
-					return Expr(new Define(var_id->s, stxs[2]->parse(env)));
+					Expr value_expr = stxs[2]->parse(env);
+					nameLambda(value_expr, stxs[2], var_id->s);
+					return Expr(new Define(var_id->s, value_expr));
 				}
 			}
         	// case E_LET:{
@@ -344,6 +371,7 @@ Expr List::parse(Assoc &env) {
 					}
 
 					Expr temp_expr = pair_it->stxs.back().get()->parse(env);
+					nameLambda(temp_expr, pair_it->stxs.back(), Identifiers->s);
 					local_env = extend(Identifiers->s, NullV(), local_env);
 					binded_vector.push_back(std::make_pair(Identifiers->s, temp_expr));
 				}
@@ -354,7 +382,7 @@ Expr List::parse(Assoc &env) {
 				}
 
 				Expr body = (body_exprs.size() == 1) ? body_exprs[0] : Expr(new Begin(body_exprs));
-				return Expr(new Let(binded_vector, body));
+				return Expr(new Let(binded_vector, body, procedureLabel("let", line)));
     		}
 
         	case E_LETREC:{
@@ -379,10 +407,11 @@ Expr List::parse(Assoc &env) {
         			SymbolSyntax *temp_id = dynamic_cast<SymbolSyntax*>(stx_tobind->stxs[0].get());
         			// 在包含所有变量的环境中解析表达式
         			Expr temp_store = stx_tobind->stxs[1]->parse(temp_env);
+        			nameLambda(temp_store, stx_tobind->stxs[1], temp_id->s);
         			binded_vector.push_back(std::make_pair(temp_id->s, temp_store));
     			}
     			// 使用同样的环境解析 body
-    			return Expr(new Letrec(binded_vector, stxs[2]->parse(temp_env)));
+    			return Expr(new Letrec(binded_vector, stxs[2]->parse(temp_env), procedureLabel("letrec", line)));
 			}
 			// case E_SET:{
 			// 	if (stxs.size() != 3) throw RuntimeError("wrong parameter number for set!");
@@ -401,6 +430,23 @@ Expr List::parse(Assoc &env) {
 				}
 				throw RuntimeError("Invalid set! syntax");
     		}
+			case E_FUTURE:{
+				if (stxs.size() != 2) throw RuntimeError("wrong parameter number for future");
+				return Expr(new MakeFuture(stxs[1]->parse(env)));
+			}
+			case E_TIME:{
+				if (stxs.size() < 2) throw RuntimeError("wrong parameter number for time");
+				if (stxs.size() == 2) return Expr(new Time(stxs[1]->parse(env)));
+				vector<Expr> body_exprs;
+				for (size_t i = 1; i < stxs.size(); i++) {
+					body_exprs.push_back(stxs[i]->parse(env));
+				}
+				return Expr(new Time(Expr(new Begin(body_exprs))));
+			}
+			case E_SAVE_IMAGE:{
+				if (stxs.size() != 2) throw RuntimeError("wrong parameter number for save-image");
+				return Expr(new SaveImage(stxs[1]->parse(env)));
+			}
         	default:
             	throw RuntimeError("Unknown reserved word: " + op);
     	}
@@ -0,0 +1,152 @@
+/**
+ * @file perf.cpp
+ * @brief Implementation of the perf_event_open counters
+ */
+
+#include "perf.hpp"
+#include "RE.hpp"
+#include "io.hpp"
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+const char *const COUNTER_NAMES[PERF_COUNTERS] = {"cycles", "instructions", "branch-misses", "cache-misses"};
+
+const unsigned long long COUNTER_CONFIGS[PERF_COUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_HW_CACHE_MISSES
+};
+
+bool report_forms = false;
+std::atomic<bool> refusal_noted(false);
+
+int openCounter(unsigned long long config) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.exclude_kernel = 1;   // 常见的 perf_event_paranoid=2 只允许统计用户态
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+/**
+ * @brief Counters of one thread, opened on first use and closed when it exits
+ */
+struct ThreadCounters {
+    bool opened;
+    int fd[PERF_COUNTERS];
+
+    ThreadCounters() : opened(false) {
+        for (int k = 0; k < PERF_COUNTERS; k++) fd[k] = -1;
+    }
+
+    ~ThreadCounters() {
+        for (int k = 0; k < PERF_COUNTERS; k++)
+            if (fd[k] >= 0) close(fd[k]);
+    }
+
+    void open() {
+        opened = true;
+        int refused = 0, error = 0;
+        for (int k = 0; k < PERF_COUNTERS; k++) {
+            fd[k] = openCounter(COUNTER_CONFIGS[k]);
+            if (fd[k] < 0) {
+                refused++;
+                if (error == 0) error = errno;
+            }
+        }
+        if (refused == PERF_COUNTERS && !refusal_noted.exchange(true)) {
+            std::cerr << "perf counters unavailable: " << std::strerror(error);
+            if (error == EACCES || error == EPERM)
+                std::cerr << " (see /proc/sys/kernel/perf_event_paranoid)";
+            std::cerr << std::endl;
+        }
+    }
+};
+
+thread_local ThreadCounters thread_counters;
+
+} // namespace
+
+void enablePerfCounters() {
+    report_forms = true;
+}
+
+bool perfCountersEnabled() {
+    return report_forms;
+}
+
+PerfReading readPerfCounters() {
+    ThreadCounters &c = thread_counters;
+    if (!c.opened) c.open();
+    PerfReading r;
+    for (int k = 0; k < PERF_COUNTERS; k++) {
+        unsigned long long data[3];   // value, time enabled, time running
+        r.valid[k] = c.fd[k] >= 0 && read(c.fd[k], data, sizeof(data)) == (ssize_t)sizeof(data);
+        r.value[k] = 0;
+        if (!r.valid[k]) continue;
+        // 计数器被复用时按运行时间比例放大
+        if (data[2] != 0 && data[2] < data[1])
+            r.value[k] = (unsigned long long)((double)data[0] * data[1] / data[2]);
+        else
+            r.value[k] = data[0];
+    }
+    return r;
+}
+
+void printPerfDelta(std::ostream &os, const char *label, const PerfReading &before, const PerfReading &after) {
+    unsigned long long delta[PERF_COUNTERS];
+    bool any = false;
+    for (int k = 0; k < PERF_COUNTERS; k++) {
+        delta[k] = after.value[k] - before.value[k];
+        any = any || (before.valid[k] && after.valid[k]);
+    }
+    if (!any) return;
+    std::string text = label;
+    text += ":";
+    char item[96];
+    const char *sep = " ";
+    for (int k = 0; k < PERF_COUNTERS; k++) {
+        if (!before.valid[k] || !after.valid[k]) continue;
+        snprintf(item, sizeof(item), "%s%llu %s", sep, delta[k], COUNTER_NAMES[k]);
+        text += item;
+        if (k == 1 && before.valid[0] && after.valid[0] && delta[0] != 0) {
+            snprintf(item, sizeof(item), " (%.2f IPC)", (double)delta[1] / delta[0]);
+            text += item;
+        }
+        sep = ", ";
+    }
+    os << text << '\n';
+}
+
+PerfScope::PerfScope(int line) : active(report_forms), line(line) {
+    if (active) start = readPerfCounters();
+}
+
+PerfScope::~PerfScope() {
+    if (!active) return;
+    PerfReading end = readPerfCounters();
+    char label[64];
+    snprintf(label, sizeof(label), "perf (line %d)", line);
+    printPerfDelta(std::cerr, label, start, end);
+}
+
+Value withPerfCountersPrimitive(const std::vector<Value> &args) {
+    if (args[0]->v_type != V_PROC && args[0]->v_type != V_PRIMITIVE) {
+        throw RuntimeError("with-perf-counters: expected a procedure");
+    }
+    PerfReading before = readPerfCounters();
+    Value result = applyProcedure(args[0], std::vector<Value>());
+    PerfReading after = readPerfCounters();
+    printPerfDelta(outputStream(), "perf", before, after);
+    return result;
+}
@@ -0,0 +1,64 @@
+#ifndef PERF_HPP
+#define PERF_HPP
+
+/**
+ * @file perf.hpp
+ * @brief Hardware performance counters around evaluations (Linux perf_event_open)
+ *
+ * Counts cycles, instructions, branch misses and cache misses of the
+ * calling thread in user space, opened lazily the first time a thread
+ * reads them:
+ *
+ *   (with-perf-counters thunk)  calls thunk, prints the deltas to the output
+ *                               and returns the thunk's value
+ *   --perf-counters             prints the deltas of every top-level form of
+ *                               the REPL to stderr
+ *
+ * Work done for the form by other threads (parallel-map workers,
+ * isolates) is not counted, while green threads scheduled on the same
+ * thread are. When the kernel refuses a counter (perf_event_paranoid, a
+ * seccomp filter, a virtual machine without a PMU) it is left out of the
+ * report; when it refuses all of them a note is printed once to stderr
+ * and evaluation goes on uncounted.
+ */
+
+#include "value.hpp"
+#include <ostream>
+#include <vector>
+
+const int PERF_COUNTERS = 4;
+
+/**
+ * @brief Counter values of the calling thread at one point in time
+ */
+struct PerfReading {
+    bool valid[PERF_COUNTERS];            ///< The counter could be opened and read
+    unsigned long long value[PERF_COUNTERS];
+};
+
+void enablePerfCounters();
+bool perfCountersEnabled();
+
+// Reads the counters of the calling thread, opening them on first use
+PerfReading readPerfCounters();
+
+// "LABEL: N cycles, N instructions (IPC), ..." for the counters valid in both readings
+void printPerfDelta(std::ostream &, const char *label, const PerfReading &before, const PerfReading &after);
+
+/**
+ * @brief Reports the counters of one top-level form with --perf-counters
+ */
+class PerfScope {
+public:
+    explicit PerfScope(int line);
+    ~PerfScope();
+
+private:
+    bool active;
+    int line;
+    PerfReading start;
+};
+
+Value withPerfCountersPrimitive(const std::vector<Value> &args);
+
+#endif // PERF_HPP
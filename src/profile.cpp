@@ -0,0 +1,294 @@
+/**
+ * @file profile.cpp
+ * @brief Implementation of the deterministic and sampling profilers
+ */
+
+#include "profile.hpp"
+#include "expr.hpp"
+#include "safepoint.hpp"
+#include "allocation.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <vector>
+#include <signal.h>
+#include <sys/time.h>
+
+bool profiling = false;
+bool sampling = false;
+
+namespace {
+
+bool counting = false;   // --profile
+bool labelling = false;  // 有使用者时才登记标签，否则解析不触碰全局集合
+std::string sample_path;
+
+struct Entry {
+    unsigned long calls;
+    uint64_t inclusive_ns;
+    uint64_t self_ns;
+    unsigned long self_bytes;   ///< Allocated while the body itself was running
+    unsigned long active;   ///< Activations of the label currently on the stack
+    Entry() : calls(0), inclusive_ns(0), self_ns(0), self_bytes(0), active(0) {}
+};
+
+typedef std::unordered_map<const std::string *, Entry> EntryTable;
+typedef std::map<std::vector<const std::string *>, unsigned long> SampleTable;
+
+struct ThreadProfile;
+
+/**
+ * @brief Labels and the counters of every thread, never destroyed
+ */
+struct Registry {
+    std::mutex lock;
+    std::set<std::string> labels;
+    std::vector<ThreadProfile *> live;
+    EntryTable retired;          ///< Counters of threads that have exited
+    SampleTable retired_samples;
+};
+
+Registry &registry() {
+    static Registry *instance = new Registry();
+    return *instance;
+}
+
+void merge(EntryTable &into, const EntryTable &from) {
+    for (auto &item : from) {
+        Entry &e = into[item.first];
+        e.calls += item.second.calls;
+        e.inclusive_ns += item.second.inclusive_ns;
+        e.self_ns += item.second.self_ns;
+        e.self_bytes += item.second.self_bytes;
+    }
+}
+
+void merge(SampleTable &into, const SampleTable &from) {
+    for (auto &item : from) into[item.first] += item.second;
+}
+
+struct ThreadProfile {
+    EntryTable entries;
+    SampleTable samples;
+    ThreadProfile() {
+        Registry &r = registry();
+        std::lock_guard<std::mutex> guard(r.lock);
+        r.live.push_back(this);
+    }
+    ~ThreadProfile() {
+        Registry &r = registry();
+        std::lock_guard<std::mutex> guard(r.lock);
+        merge(r.retired, entries);
+        merge(r.retired_samples, samples);
+        r.live.erase(std::remove(r.live.begin(), r.live.end(), this), r.live.end());
+    }
+};
+
+thread_local ThreadProfile thread_profile;
+thread_local ProfileFrame *profile_top = nullptr;
+
+inline uint64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+/**
+ * @brief One procedure body or scope on the shadow stack
+ *
+ * Only procedure frames are timed (entry is set) and only with --profile;
+ * a timed frame reports its time to the nearest timed frame below it.
+ */
+struct ProfileFrame {
+    ProfileFrame *parent;
+    const std::string *label;
+    Entry *entry;
+    ProfileFrame *caller;   ///< Nearest timed frame below this one
+    uint64_t start;
+    uint64_t child_ns;
+    unsigned long start_bytes;
+    unsigned long child_bytes;
+
+    ProfileFrame(const std::string *label, bool timed)
+        : parent(profile_top), label(label), entry(nullptr), caller(nullptr), start(0), child_ns(0),
+          start_bytes(0), child_bytes(0) {
+        profile_top = this;
+        if (parent != nullptr) caller = parent->entry != nullptr ? parent : parent->caller;
+        if (!timed) return;
+        entry = &thread_profile.entries[label];
+        entry->calls++;
+        entry->active++;
+        start_bytes = threadAllocatedBytes();
+        start = nowNs();
+    }
+
+    ~ProfileFrame() {
+        profile_top = parent;
+        if (entry == nullptr) return;
+        uint64_t elapsed = nowNs() - start;
+        unsigned long allocated = threadAllocatedBytes() - start_bytes;
+        entry->self_ns += elapsed > child_ns ? elapsed - child_ns : 0;
+        entry->self_bytes += allocated - child_bytes;
+        // 递归调用只在最外层计入包含时间
+        if (--entry->active == 0) entry->inclusive_ns += elapsed;
+        if (caller != nullptr) {
+            caller->child_ns += elapsed;
+            caller->child_bytes += allocated;
+        }
+    }
+};
+
+namespace {
+
+// Sample handler, runs at a safepoint of the sampled thread
+void takeSample() {
+    if (!safepoint_state.active.load(std::memory_order_relaxed)) return;  // 线程空闲
+    std::vector<const std::string *> stack;
+    for (ProfileFrame *f = profile_top; f != nullptr; f = f->parent) stack.push_back(f->label);
+    std::reverse(stack.begin(), stack.end());
+    thread_profile.samples[stack]++;
+}
+
+void onProfileTick(int) {
+    requestSafepointAll(SAFEPOINT_SAMPLE);
+}
+
+void stopSampling() {
+    struct itimerval timer = {{0, 0}, {0, 0}};
+    setitimer(ITIMER_PROF, &timer, nullptr);
+}
+
+void printTable(std::ostream &os, const EntryTable &total) {
+    std::vector<std::pair<const std::string *, Entry>> rows(total.begin(), total.end());
+    std::sort(rows.begin(), rows.end(), [](const std::pair<const std::string *, Entry> &a,
+                                           const std::pair<const std::string *, Entry> &b) {
+        return a.second.self_ns > b.second.self_ns;
+    });
+    unsigned long calls = 0;
+    uint64_t self_ns = 0;
+    for (auto &row : rows) {
+        calls += row.second.calls;
+        self_ns += row.second.self_ns;
+    }
+
+    char line[128];
+    snprintf(line, sizeof(line), "profile: %lu calls of %lu procedures, %.1f ms in procedure bodies\n",
+             calls, (unsigned long)rows.size(), self_ns / 1e6);
+    os << line;
+    snprintf(line, sizeof(line), "%12s %12s %12s %7s %12s  %s\n", "calls", "incl ms", "self ms", "self %", "self kB",
+             "procedure");
+    os << line;
+    for (auto &row : rows) {
+        const Entry &e = row.second;
+        snprintf(line, sizeof(line), "%12lu %12.2f %12.2f %6.1f%% %12.1f  ", e.calls, e.inclusive_ns / 1e6,
+                 e.self_ns / 1e6, self_ns == 0 ? 0.0 : e.self_ns * 100.0 / self_ns, e.self_bytes / 1024.0);
+        os << line << (row.first != nullptr ? *row.first : std::string("lambda")) << '\n';
+    }
+    os.flush();
+}
+
+bool writeSamples(const std::string &path, const SampleTable &samples) {
+    FILE *out = fopen(path.c_str(), "w");
+    if (out == nullptr) return false;
+    for (auto &item : samples) {
+        std::string stack;
+        for (const std::string *label : item.first) {
+            if (!stack.empty()) stack += ';';
+            stack += label != nullptr ? *label : std::string("lambda");
+        }
+        if (stack.empty()) stack = "(top level)";
+        fprintf(out, "%s %lu\n", stack.c_str(), item.second);
+    }
+    return fclose(out) == 0;
+}
+
+} // namespace
+
+void enableProfiling() {
+    counting = true;
+    profiling = true;
+    labelling = true;
+}
+
+void startSampling(const std::string &path, unsigned rate) {
+    sample_path = path;
+    sampling = true;
+    profiling = true;
+    labelling = true;
+    setSampleHandler(takeSample);
+
+    struct sigaction action;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    action.sa_handler = onProfileTick;
+    sigaction(SIGPROF, &action, nullptr);
+
+    long interval_us = 1000000L / (rate == 0 ? 1000 : rate);
+    if (interval_us == 0) interval_us = 1;
+    struct itimerval timer;
+    timer.it_interval.tv_sec = interval_us / 1000000;
+    timer.it_interval.tv_usec = interval_us % 1000000;
+    timer.it_value = timer.it_interval;
+    setitimer(ITIMER_PROF, &timer, nullptr);
+}
+
+void enableLabels() {
+    labelling = true;
+}
+
+const std::string *internLabel(const std::string &label) {
+    if (!labelling) return nullptr;
+    Registry &r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    return &*r.labels.insert(label).first;
+}
+
+const std::string *procedureLabel(const std::string &name, int line) {
+    if (!labelling) return nullptr;
+    std::string label = name.empty() ? "lambda" : name;
+    if (line > 0) label += " (line " + std::to_string(line) + ")";
+    return internLabel(label);
+}
+
+Value profiledCall(Procedure *proc, Assoc &env) {
+    ProfileFrame frame(proc->label, counting);
+    return proc->e->eval(env);
+}
+
+Value sampledScope(const std::string *label, const Expr &body, Assoc &env) {
+    ProfileFrame frame(label, false);
+    return body->eval(env);
+}
+
+ProfileFrame *profileTop() {
+    return profile_top;
+}
+
+void setProfileTop(ProfileFrame *frame) {
+    profile_top = frame;
+}
+
+void reportProfiles(std::ostream &os) {
+    if (sampling) stopSampling();
+    EntryTable total;
+    SampleTable samples;
+    {
+        Registry &r = registry();
+        std::lock_guard<std::mutex> guard(r.lock);
+        total = r.retired;
+        samples = r.retired_samples;
+        for (ThreadProfile *p : r.live) {
+            merge(total, p->entries);
+            merge(samples, p->samples);
+        }
+    }
+    if (counting) printTable(os, total);
+    if (sampling && !writeSamples(sample_path, samples))
+        os << "cannot write samples to " << sample_path << std::endl;
+}
@@ -0,0 +1,85 @@
+#ifndef PROFILE_HPP
+#define PROFILE_HPP
+
+/**
+ * @file profile.hpp
+ * @brief Deterministic (--profile) and sampling (--sample) profilers
+ *
+ * Every lambda is labelled when it is parsed: by the name it is bound to
+ * with define, let or letrec, otherwise as "lambda", followed by the line
+ * of its source, e.g. "fib (line 3)". let and letrec scopes are labelled
+ * "let (line 7)" and "letrec (line 9)". Labels are only made while a
+ * profiler or --trace is on; otherwise every label is nullptr, so parsing
+ * never touches the interned set and a long --stream run does not grow it.
+ *
+ * Both profilers share a shadow stack: a chain of frames living on the
+ * C++ stack, one per active procedure body and, while sampling, one per
+ * let or letrec body. A green thread has its own chain, so switching
+ * between green threads keeps it consistent.
+ *
+ * With --profile each application of a compound procedure is timed, and
+ * at exit a table sorted by self time is printed to stderr with, per
+ * label, the number of calls, the inclusive time (counted once for
+ * recursive activations) and the self time (inclusive minus the time of
+ * profiled callees), plus the bytes allocated by the body itself (see
+ * allocation.hpp). Time spent in primitives is part of the caller's self
+ * time.
+ *
+ * With --sample FILE a SIGPROF timer (ITIMER_PROF, --sample-rate per
+ * second of CPU time, 1000 by default, in practice capped by the kernel's
+ * timer tick) asks every evaluating thread for a sample. The thread
+ * copies its shadow stack at its next safepoint, so the signal handler
+ * only sets a flag; a long primitive is charged to the frame active when
+ * it returns. At exit FILE receives the samples in
+ * folded-stack form ("outer;inner count" per line) for flamegraph.pl or
+ * speedscope.
+ *
+ * When both are off the only cost is one predictable branch per
+ * procedure application and per let or letrec body.
+ */
+
+#include "value.hpp"
+#include <ostream>
+#include <string>
+
+extern bool profiling;   ///< Frames are pushed (either profiler is on)
+extern bool sampling;    ///< let and letrec scopes are pushed too
+
+inline bool profilingEnabled() {
+    return profiling;
+}
+
+inline bool samplingEnabled() {
+    return sampling;
+}
+
+void enableProfiling();
+
+// Starts the SIGPROF sampler; the folded stacks are written to path at exit
+void startSampling(const std::string &path, unsigned rate);
+
+// Makes the two functions below return labels; called before anything is parsed
+void enableLabels();
+
+// Interned label, nullptr unless labels are enabled; the pointer stays valid for the life of the process
+const std::string *internLabel(const std::string &label);
+
+// "NAME (line LINE)", with "lambda" for an empty name and no line if it is 0
+const std::string *procedureLabel(const std::string &name, int line);
+
+// Evaluates the body of an applied procedure in its parameter frame under a profiler frame
+Value profiledCall(Procedure *proc, Assoc &env);
+
+// Evaluates a let or letrec body under a sampler frame
+Value sampledScope(const std::string *label, const Expr &body, Assoc &env);
+
+struct ProfileFrame;
+
+// Chain of frames of the running context, swapped by green thread switches
+ProfileFrame *profileTop();
+void setProfileTop(ProfileFrame *);
+
+// Prints the --profile table and writes the --sample file, whichever are enabled
+void reportProfiles(std::ostream &);
+
+#endif // PROFILE_HPP
@@ -0,0 +1,382 @@
+/**
+ * @file purity.cpp
+ * @brief Implementation of the effect analysis behind --parallel-args
+ */
+
+#include "purity.hpp"
+#include "scheduler.hpp"
+#include "RE.hpp"
+#include "limits.hpp"
+#include <algorithm>
+#include <map>
+
+extern const std::map<std::string, ExprType> primitives;
+
+namespace {
+
+const unsigned long UNBOUNDED = 0x7fffffffUL;   ///< Cost of recursion; also the largest cost stored
+
+std::atomic<bool> enabled(false);
+unsigned long threshold = 256;
+std::atomic<unsigned long> binding_epoch(1);
+
+unsigned long addCost(unsigned long a, unsigned long b) {
+    return std::min(UNBOUNDED, a + b);
+}
+
+// Built-in operations without observable effects
+bool pureOperation(ExprType t) {
+    switch (t) {
+        case E_PLUS: case E_MINUS: case E_MUL: case E_DIV: case E_MODULO: case E_EXPT:
+        case E_LT: case E_LE: case E_EQ: case E_GE: case E_GT:
+        case E_CONS: case E_CAR: case E_CDR: case E_LIST:
+        case E_NOT: case E_AND: case E_OR:
+        case E_EQQ: case E_BOOLQ: case E_INTQ: case E_NULLQ: case E_PAIRQ:
+        case E_PROCQ: case E_SYMBOLQ: case E_LISTQ: case E_STRINGQ:
+        case E_VOID: case E_COMMAND_LINE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief What an expression does, before its free callees are looked up
+ */
+struct Summary {
+    bool pure;
+    unsigned long cost;                  ///< Node count, callees excluded
+    std::vector<std::string> callees;    ///< Free names called in operator position
+    Summary() : pure(true), cost(0) {}
+};
+
+class Summarizer {
+public:
+    explicit Summarizer(Summary &out) : out(out) {}
+
+    void bind(const std::string &name) { bound.push_back(name); }
+
+    void walk(const Expr &expr) {
+        ExprBase *e = expr.get();
+        if (!out.pure) return;
+        out.cost = addCost(out.cost, 1);
+        switch (e->e_type) {
+            case E_FIXNUM: case E_RATIONAL: case E_STRING: case E_TRUE: case E_FALSE:
+            case E_VOID: case E_QUOTE: case E_VAR: case E_LAMBDA:
+                return;
+            case E_IF: {
+                If *node = static_cast<If*>(e);
+                walk(node->cond);
+                walk(node->conseq);
+                walk(node->alter);
+                return;
+            }
+            case E_COND:
+                for (auto &clause : static_cast<Cond*>(e)->clauses)
+                    for (auto &sub : clause) walk(sub);
+                return;
+            case E_AND:
+                for (auto &sub : static_cast<AndVar*>(e)->rands) walk(sub);
+                return;
+            case E_OR:
+                for (auto &sub : static_cast<OrVar*>(e)->rands) walk(sub);
+                return;
+            case E_BEGIN: {
+                // 开头连续的内部 define 只建立局部绑定，与 Begin::eval 一致
+                size_t mark = bound.size();
+                std::vector<Expr> &es = static_cast<Begin*>(e)->es;
+                size_t i = 0;
+                for (; i < es.size() && es[i]->e_type == E_DEFINE; i++) bind(static_cast<Define*>(es[i].get())->var);
+                for (size_t j = 0; j < i; j++) walk(static_cast<Define*>(es[j].get())->e);
+                for (; i < es.size(); i++) walk(es[i]);
+                bound.resize(mark);
+                return;
+            }
+            case E_LET:
+            case E_LETREC: {
+                size_t mark = bound.size();
+                bool rec = e->e_type == E_LETREC;
+                auto &bind_list = rec ? static_cast<Letrec*>(e)->bind : static_cast<Let*>(e)->bind;
+                if (rec) for (auto &b : bind_list) bind(b.first);
+                for (auto &b : bind_list) walk(b.second);
+                if (!rec) for (auto &b : bind_list) bind(b.first);
+                walk(rec ? static_cast<Letrec*>(e)->body : static_cast<Let*>(e)->body);
+                bound.resize(mark);
+                return;
+            }
+            case E_APPLY: {
+                Apply *node = static_cast<Apply*>(e);
+                ExprBase *rator = node->rator.get();
+                if (rator->e_type == E_VAR) {
+                    const std::string &name = static_cast<Var*>(rator)->x;
+                    if (std::find(bound.begin(), bound.end(), name) != bound.end()) {
+                        out.pure = false;   // 形参或局部绑定，调用目标未知
+                        return;
+                    }
+                    if (std::find(out.callees.begin(), out.callees.end(), name) == out.callees.end())
+                        out.callees.push_back(name);
+                } else if (rator->e_type == E_LAMBDA) {
+                    Lambda *lambda = static_cast<Lambda*>(rator);
+                    size_t mark = bound.size();
+                    for (auto &x : lambda->x) bind(x);
+                    walk(lambda->e);
+                    bound.resize(mark);
+                } else {
+                    out.pure = false;
+                    return;
+                }
+                for (auto &sub : node->rand) walk(sub);
+                return;
+            }
+            default:
+                break;
+        }
+        if (!pureOperation(e->e_type)) {
+            out.pure = false;
+            return;
+        }
+        if (auto u = dynamic_cast<Unary*>(e)) {
+            walk(u->rand);
+        } else if (auto b = dynamic_cast<Binary*>(e)) {
+            walk(b->rand1);
+            walk(b->rand2);
+        } else if (auto v = dynamic_cast<Variadic*>(e)) {
+            for (auto &sub : v->rands) walk(sub);
+        }
+    }
+
+private:
+    Summary &out;
+    std::vector<std::string> bound;
+};
+
+struct Analysis {
+    bool pure;
+    unsigned long cost;
+};
+
+unsigned long long encode(const Analysis &a, unsigned long epoch) {
+    return ((unsigned long long)(epoch & 0xffffffffUL) << 32) | ((unsigned long long)a.pure << 31) | a.cost;
+}
+
+bool cached(Procedure *p, unsigned long epoch, Analysis &a) {
+    unsigned long long bits = p->analysis.load(std::memory_order_acquire);
+    if (bits == 0 || (bits >> 32) != (epoch & 0xffffffffUL)) return false;
+    a.pure = (bits >> 31) & 1;
+    a.cost = bits & UNBOUNDED;
+    return true;
+}
+
+/**
+ * @brief One analysis run over the procedures reachable from a call
+ *
+ * A procedure already on the way is assumed pure with unbounded cost. An
+ * assumption can only be wrong if something reachable is impure, and then
+ * so is the procedure the walk started from. Only that outermost result is
+ * cached on the procedure, and the memo is dropped before the next one.
+ */
+class Analyzer {
+public:
+    Analyzer() : epoch(binding_epoch.load()), depth(0) {}
+
+    Analysis resolve(const Summary &s, Assoc &env) {
+        Analysis a = {s.pure, s.cost};
+        for (size_t i = 0; a.pure && i < s.callees.size(); i++) {
+            Analysis callee = call(s.callees[i], env);
+            a.pure = callee.pure;
+            a.cost = addCost(a.cost, callee.cost);
+        }
+        return a;
+    }
+
+private:
+    Analysis call(const std::string &name, Assoc &env) {
+        Value v = find(name, env);
+        if (v.get() == nullptr) {
+            auto prim = primitives.find(name);
+            return Analysis{prim != primitives.end() && pureOperation(prim->second), 1};
+        }
+        if (v->v_type == V_PRIMITIVE) {
+            auto prim = primitives.find(static_cast<Primitive*>(v.get())->name);
+            return Analysis{prim != primitives.end() && pureOperation(prim->second), 1};
+        }
+        if (v->v_type != V_PROC) return Analysis{false, 0};
+        keep.push_back(v);
+        return procedure(static_cast<Procedure*>(v.get()));
+    }
+
+    Analysis procedure(Procedure *p) {
+        Analysis a;
+        if (cached(p, epoch, a)) return a;
+        auto seen = memo.find(p);
+        if (seen != memo.end()) return seen->second;
+        memo.insert({p, Analysis{true, UNBOUNDED}});
+
+        Summary s;
+        Summarizer walker(s);
+        for (auto &x : p->parameters) walker.bind(x);
+        walker.walk(p->e);
+        depth++;
+        a = resolve(s, p->env);
+        depth--;
+        if (depth == 0) {
+            p->analysis.store(encode(a, epoch), std::memory_order_release);
+            memo.clear();
+        } else {
+            memo[p] = a;
+        }
+        return a;
+    }
+
+    unsigned long epoch;
+    int depth;
+    std::map<Procedure *, Analysis> memo;
+    std::vector<Value> keep;   ///< Callees found through overlays stay alive during the run
+};
+
+/**
+ * @brief Operand evaluated on another thread
+ */
+struct OperandTask : Scheduler::Task {
+    Expr expr;
+    Assoc env;
+    std::shared_ptr<EnvOverlay> overlay;
+    std::shared_ptr<RequestBudget> budget;
+    Value result;
+    bool failed;
+    std::string error;
+    std::atomic<bool> done;
+
+    OperandTask(const Expr &expr, const Assoc &env)
+        : expr(expr), env(env), overlay(activeOverlay()), budget(currentBudget()), result(nullptr), failed(false), done(false) {}
+
+    virtual void run() override {
+        BudgetScope scope(budget);
+        std::shared_ptr<EnvOverlay> saved = activeOverlay();
+        setActiveOverlay(overlay);
+        try {
+            result = expr->eval(env);
+        } catch (const RuntimeError &err) {
+            failed = true;
+            error = err.message();
+        } catch (const std::exception &err) {
+            failed = true;
+            error = err.what();
+        } catch (...) {
+            failed = true;
+            error = "unknown error in operand";
+        }
+        setActiveOverlay(saved);
+        done.store(true, std::memory_order_release);
+    }
+};
+
+} // namespace
+
+/**
+ * @brief Syntactic summaries of a call site's operands
+ */
+struct ArgPlan {
+    bool sequential;                   ///< Never worth evaluating in parallel
+    std::vector<Summary> operands;
+};
+
+ArgPlanSlot::~ArgPlanSlot() {
+    delete plan.load();
+}
+
+void configureParallelArgs(bool on, unsigned long cost_threshold) {
+    threshold = std::min(UNBOUNDED, cost_threshold);
+    enabled = on;
+}
+
+bool parallelArgsEnabled() {
+    return enabled.load(std::memory_order_relaxed);
+}
+
+void noteRebinding(const std::string &name, const Value &old) {
+    if (!enabled.load(std::memory_order_relaxed)) return;
+    // 只有能被调用的旧值才可能让分析得出“纯”；其他旧值对应的结论本来就是不纯，保持保守即可。
+    // letrec、内部 define 填充占位符和给数据变量赋值都不会丢掉缓存
+    if (old.get() == nullptr ? primitives.count(name) == 0 : old->v_type != V_PROC && old->v_type != V_PRIMITIVE)
+        return;
+    binding_epoch.fetch_add(1, std::memory_order_relaxed);
+}
+
+static ArgPlan *buildPlan(const Expr *rands, size_t n) {
+    ArgPlan *plan = new ArgPlan();
+    plan->operands.resize(n);
+    size_t candidates = 0;
+    bool pure = true;
+    for (size_t i = 0; i < n; i++) {
+        Summarizer walker(plan->operands[i]);
+        walker.walk(rands[i]);
+        pure = pure && plan->operands[i].pure;
+        if (plan->operands[i].cost >= threshold || !plan->operands[i].callees.empty()) candidates++;
+    }
+    plan->sequential = !pure || candidates < 2;
+    return plan;
+}
+
+bool evalArgsInParallel(ArgPlanSlot &slot, const Expr *rands, size_t n, Assoc &env, std::vector<Value> &args) {
+    ArgPlan *plan = slot.plan.load(std::memory_order_acquire);
+    if (plan == nullptr) {
+        ArgPlan *fresh = buildPlan(rands, n);
+        if (slot.plan.compare_exchange_strong(plan, fresh, std::memory_order_acq_rel)) {
+            plan = fresh;
+        } else {
+            delete fresh;
+        }
+    }
+    if (plan->sequential) {
+        slot.sequential.store(true, std::memory_order_relaxed);
+        return false;
+    }
+
+    Scheduler &scheduler = Scheduler::instance();
+    if (scheduler.threads() < 2 || !scheduler.localQueueEmpty()) return false;
+
+    // 每次调用都在当前环境中查找被调用者，形参传入的过程也能得到正确结论
+    Analyzer analyzer;
+    std::vector<size_t> heavy;
+    for (size_t i = 0; i < n; i++) {
+        const Summary &s = plan->operands[i];
+        Analysis a = analyzer.resolve(s, env);
+        if (!a.pure) return false;
+        if (a.cost >= threshold) heavy.push_back(i);
+    }
+    if (heavy.size() < 2) return false;
+
+    // 除最后一个开销大的操作数外都交给线程池，其余在当前线程按顺序求值
+    std::vector<std::shared_ptr<OperandTask>> tasks(n);
+    for (size_t k = 0; k + 1 < heavy.size(); k++) {
+        tasks[heavy[k]] = std::make_shared<OperandTask>(rands[heavy[k]], env);
+        scheduler.spawn(tasks[heavy[k]]);
+    }
+    args.assign(n, Value(nullptr));
+    std::vector<std::string> errors(n);
+    std::vector<bool> failed(n, false);
+    for (size_t i = 0; i < n; i++) {
+        if (tasks[i]) continue;
+        try {
+            args[i] = rands[i]->eval(env);
+        } catch (const RuntimeError &err) {
+            failed[i] = true;
+            errors[i] = err.message();
+        }
+    }
+    scheduler.helpUntil([&]() {
+        for (auto &t : tasks)
+            if (t && !t->done.load(std::memory_order_acquire)) return false;
+        return true;
+    });
+    for (size_t i = 0; i < n; i++) {
+        if (tasks[i]) {
+            failed[i] = tasks[i]->failed;
+            errors[i] = tasks[i]->error;
+            args[i] = tasks[i]->result;
+        }
+        if (failed[i]) throw RuntimeError(errors[i]);
+    }
+    return true;
+}
@@ -0,0 +1,45 @@
+#ifndef PURITY_HPP
+#define PURITY_HPP
+
+/**
+ * @file purity.hpp
+ * @brief Effect analysis and parallel evaluation of call operands
+ *
+ * With --parallel-args, a call whose operands are all pure may evaluate
+ * the expensive ones concurrently on the scheduler's threads. An operand
+ * is pure when it contains no set!, set-car!, set-cdr!, display, define
+ * outside a body, or other operation with an effect, and every procedure
+ * it calls is pure as well. Calls through a parameter or local binding are
+ * not followed and count as impure.
+ *
+ * Cost is a static estimate: one per expression node, plus the body cost
+ * of each non-recursive procedure called, while a recursive procedure
+ * counts as unbounded. A call goes parallel when at least two operands
+ * reach the threshold (--parallel-args-cost, 256 by default) and the
+ * calling thread has no task of its own already waiting, so recursion
+ * only spawns while other threads may be idle.
+ *
+ * The syntactic part of the analysis is cached on the call site. The
+ * result for a procedure is cached on the procedure and dropped whenever
+ * a binding that held a procedure or primitive, or a placeholder named
+ * like a primitive, is modified, since that may change what its body
+ * calls. Any other old value made the analysis say impure, which stays
+ * safe, so filling letrec and internal-define placeholders or assigning
+ * data variables keeps the cache.
+ * Operands that fail are reported in order, as if evaluated sequentially.
+ */
+
+#include "expr.hpp"
+#include "value.hpp"
+
+void configureParallelArgs(bool enabled, unsigned long cost_threshold);
+bool parallelArgsEnabled();
+
+// Invalidates the cached analysis of every procedure if old, the value name is losing, may have made one pure
+void noteRebinding(const std::string &name, const Value &old);
+
+// Evaluates rands[0..n) into args, concurrently if the plan allows it.
+// Returns false without evaluating anything when the call must stay sequential.
+bool evalArgsInParallel(ArgPlanSlot &slot, const Expr *rands, size_t n, Assoc &env, std::vector<Value> &args);
+
+#endif // PURITY_HPP
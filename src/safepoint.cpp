@@ -0,0 +1,208 @@
+/**
+ * @file safepoint.cpp
+ * @brief Implementation of safepoint requests, signal handlers and the timeout watchdog
+ */
+
+#include "safepoint.hpp"
+#include "limits.hpp"
+#include "RE.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <signal.h>
+
+thread_local SafepointState safepoint_state;
+
+namespace {
+
+const int MAX_THREADS = 256;
+
+std::atomic<SafepointState *> registry[MAX_THREADS];
+std::atomic<SafepointState *> interrupt_target(nullptr);
+std::atomic<void (*)()> sample_handler(nullptr);
+
+/**
+ * @brief Keeps the thread's slot in the registry until the thread exits
+ */
+struct Registration {
+    int slot;
+    Registration() : slot(-1) {}
+    ~Registration() {
+        if (slot >= 0) registry[slot].store(nullptr);
+    }
+    void ensure() {
+        if (slot >= 0) return;
+        for (int i = 0; i < MAX_THREADS; i++) {
+            SafepointState *expected = nullptr;
+            if (registry[i].compare_exchange_strong(expected, &safepoint_state)) {
+                slot = i;
+                return;
+            }
+        }
+        // 表已满：该线程收不到广播请求，超时与中断仍按线程生效
+    }
+};
+
+thread_local Registration registration;
+
+/**
+ * @brief Sets SAFEPOINT_TIMEOUT on threads whose deadline has passed
+ */
+class Watchdog {
+public:
+    Watchdog() : started(false) {}
+
+    // Returns whether a deadline was already armed, and stores it in previous
+    bool arm(SafepointState *state, unsigned long timeout_ms, std::chrono::steady_clock::time_point &previous) {
+        std::lock_guard<std::mutex> guard(lock);
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        auto it = deadlines.find(state);
+        bool had = it != deadlines.end();
+        if (had) {
+            previous = it->second;
+            it->second = std::min(it->second, deadline);
+        } else {
+            deadlines[state] = deadline;
+        }
+        if (!started) {
+            started = true;
+            std::thread(&Watchdog::run, this).detach();
+        }
+        changed.notify_one();
+        return had;
+    }
+
+    void disarm(SafepointState *state) {
+        std::lock_guard<std::mutex> guard(lock);
+        deadlines.erase(state);
+    }
+
+    // Puts an outer deadline back; one that has passed fires at once
+    void restore(SafepointState *state, std::chrono::steady_clock::time_point deadline) {
+        std::lock_guard<std::mutex> guard(lock);
+        deadlines[state] = deadline;
+        changed.notify_one();
+    }
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> guard(lock);
+        while (1) {
+            if (deadlines.empty()) {
+                changed.wait(guard);
+                continue;
+            }
+            auto now = std::chrono::steady_clock::now();
+            auto earliest = now + std::chrono::hours(1);
+            for (auto it = deadlines.begin(); it != deadlines.end();) {
+                if (it->second <= now) {
+                    it->first->flag.fetch_or(SAFEPOINT_TIMEOUT);
+                    it = deadlines.erase(it);
+                } else {
+                    earliest = std::min(earliest, it->second);
+                    ++it;
+                }
+            }
+            changed.wait_until(guard, earliest);
+        }
+    }
+
+    std::mutex lock;
+    std::condition_variable changed;
+    std::map<SafepointState *, std::chrono::steady_clock::time_point> deadlines;
+    bool started;
+};
+
+// Never destroyed: the detached watchdog thread may outlive static destructors
+Watchdog &watchdog() {
+    static Watchdog *instance = new Watchdog();
+    return *instance;
+}
+
+void dumpStats() {
+    char line[160];
+    snprintf(line, sizeof(line), "[stats] thread %d: steps %lu, heap %lu bytes, depth %lu\n",
+             registration.slot, eval_budget.steps, eval_budget.heap, eval_budget.depth);
+    fputs(line, stderr);
+}
+
+void onInterrupt(int) {
+    SafepointState *target = interrupt_target.load();
+    if (target == nullptr || !target->active.load() || (target->flag.load() & SAFEPOINT_INTERRUPT)) {
+        // 没有可中断的求值，或上一次中断还没被处理：按默认方式结束进程
+        signal(SIGINT, SIG_DFL);
+        raise(SIGINT);
+        return;
+    }
+    target->flag.fetch_or(SAFEPOINT_INTERRUPT);
+}
+
+void onStatsRequest(int) {
+    requestSafepointAll(SAFEPOINT_STATS);
+}
+
+} // namespace
+
+void safepointSlowPath() {
+    int bits = safepoint_state.flag.exchange(0);
+    if (bits & SAFEPOINT_STATS) dumpStats();
+    if (bits & SAFEPOINT_SAMPLE) {
+        void (*handler)() = sample_handler.load();
+        if (handler != nullptr) handler();
+    }
+    if (!safepoint_state.active.load(std::memory_order_relaxed)) return;
+    if (bits & SAFEPOINT_INTERRUPT) throw RuntimeError("Interrupted");
+    if (bits & SAFEPOINT_TIMEOUT) throw RuntimeError("Timeout");
+}
+
+void requestSafepointAll(int bits) {
+    for (int i = 0; i < MAX_THREADS; i++) {
+        SafepointState *state = registry[i].load();
+        if (state != nullptr) state->flag.fetch_or(bits);
+    }
+}
+
+void setSampleHandler(void (*handler)()) {
+    sample_handler.store(handler);
+}
+
+void installSafepointSignals() {
+    registration.ensure();
+    interrupt_target.store(&safepoint_state);
+
+    struct sigaction action;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    action.sa_handler = onInterrupt;
+    sigaction(SIGINT, &action, nullptr);
+    action.sa_handler = onStatsRequest;
+    sigaction(SIGUSR1, &action, nullptr);
+}
+
+SafepointScope::SafepointScope(unsigned long timeout_ms) : owner(false), armed(false), had_previous(false) {
+    if (!safepoint_state.active.load(std::memory_order_relaxed)) {
+        registration.ensure();
+        owner = true;
+        safepoint_state.active.store(true);
+    }
+    if (timeout_ms != 0) {
+        had_previous = watchdog().arm(&safepoint_state, timeout_ms, previous);
+        armed = true;
+    }
+}
+
+SafepointScope::~SafepointScope() {
+    if (armed) {
+        if (had_previous) watchdog().restore(&safepoint_state, previous);
+        else watchdog().disarm(&safepoint_state);
+    }
+    if (owner) {
+        // 求值结束后才到达的中断与超时不再影响下一次求值
+        safepoint_state.active.store(false);
+        safepoint_state.flag.fetch_and(~(SAFEPOINT_INTERRUPT | SAFEPOINT_TIMEOUT));
+    }
+}
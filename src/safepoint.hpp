@@ -0,0 +1,79 @@
+#ifndef SAFEPOINT_HPP
+#define SAFEPOINT_HPP
+
+/**
+ * @file safepoint.hpp
+ * @brief Points where the evaluator reacts to asynchronous requests
+ *
+ * Every evaluating thread owns a flag word. Signal handlers, the timeout
+ * watchdog and other threads set bits in it; the evaluator polls it at
+ * procedure entry (Apply::eval) and on the back edge of every body
+ * (Begin::eval), and also while blocked in isolate-receive or waiting for
+ * parallel work. The poll is a single relaxed load and a branch that is
+ * not taken in the steady state.
+ *
+ *   SIGINT    aborts the current form or request with RuntimeError
+ *             "Interrupted"; a second SIGINT before the first is seen,
+ *             or one arriving while nothing is evaluated, terminates
+ *   SIGUSR1   every evaluating thread prints its step, heap and depth
+ *             counters to stderr at its next safepoint
+ *   timeout   Limits::timeout_ms arms a deadline for the evaluation;
+ *             when it passes the evaluation fails with "Timeout"
+ *   sample    calls the handler set by setSampleHandler (for profilers)
+ */
+
+#include <atomic>
+#include <chrono>
+
+enum SafepointRequest {
+    SAFEPOINT_INTERRUPT = 1,
+    SAFEPOINT_TIMEOUT   = 2,
+    SAFEPOINT_STATS     = 4,
+    SAFEPOINT_SAMPLE    = 8
+};
+
+/**
+ * @brief Per-thread request word and evaluation state
+ */
+struct SafepointState {
+    std::atomic<int> flag;       ///< Pending SafepointRequest bits
+    std::atomic<bool> active;    ///< An evaluation is running on the thread
+};
+
+extern thread_local SafepointState safepoint_state;
+
+void safepointSlowPath();
+
+inline void safepointPoll() {
+    if (__builtin_expect(safepoint_state.flag.load(std::memory_order_relaxed) != 0, 0))
+        safepointSlowPath();
+}
+
+// Sets bits on every thread that has evaluated something (async-signal-safe)
+void requestSafepointAll(int bits);
+
+// Called at the next safepoint of a thread asked for SAFEPOINT_SAMPLE
+void setSampleHandler(void (*handler)());
+
+// Installs the SIGINT and SIGUSR1 handlers; the calling thread receives interrupts
+void installSafepointSignals();
+
+/**
+ * @brief Marks the calling thread as evaluating and arms its timeout, if any
+ *
+ * A scope nested in another one that armed a deadline (a task of another
+ * evaluation run while waiting) fires at the earlier of the two, and puts
+ * the outer deadline back when it ends.
+ */
+class SafepointScope {
+public:
+    explicit SafepointScope(unsigned long timeout_ms);
+    ~SafepointScope();
+private:
+    bool owner;
+    bool armed;
+    bool had_previous;
+    std::chrono::steady_clock::time_point previous;
+};
+
+#endif // SAFEPOINT_HPP
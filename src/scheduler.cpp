@@ -0,0 +1,104 @@
+/**
+ * @file scheduler.cpp
+ * @brief Implementation of the work-stealing thread pool
+ */
+
+#include "scheduler.hpp"
+
+static int configured_threads = 0;
+static thread_local int queue_index = -1;   // -1: not a pool thread
+
+void Scheduler::configure(int threads) {
+    configured_threads = threads;
+}
+
+Scheduler &Scheduler::instance() {
+    static Scheduler scheduler(configured_threads > 0 ? configured_threads
+                                                      : (int)std::thread::hardware_concurrency());
+    return scheduler;
+}
+
+Scheduler::Scheduler(int threads) : pending(0), stopping(false) {
+    if (threads < 1) threads = 1;
+    // 调用方线程也参与执行，因此池中只需 threads - 1 个线程
+    for (int i = 0; i < threads; i++) {
+        queues.push_back(std::unique_ptr<Queue>(new Queue));
+    }
+    for (int i = 0; i + 1 < threads; i++) {
+        pool.push_back(std::thread(&Scheduler::workerLoop, this, (size_t)i));
+    }
+}
+
+Scheduler::~Scheduler() {
+    {
+        std::lock_guard<std::mutex> guard(idle_lock);
+        stopping = true;
+    }
+    idle.notify_all();
+    for (auto &t : pool) t.join();
+}
+
+int Scheduler::threads() const {
+    return (int)queues.size();
+}
+
+void Scheduler::spawn(const std::shared_ptr<Task> &task) {
+    size_t index = queue_index >= 0 ? (size_t)queue_index : queues.size() - 1;
+    {
+        std::lock_guard<std::mutex> guard(queues[index]->lock);
+        queues[index]->tasks.push_back(task);
+    }
+    pending.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> guard(idle_lock);
+    }
+    idle.notify_one();
+}
+
+bool Scheduler::localQueueEmpty() {
+    size_t index = queue_index >= 0 ? (size_t)queue_index : queues.size() - 1;
+    std::lock_guard<std::mutex> guard(queues[index]->lock);
+    return queues[index]->tasks.empty();
+}
+
+std::shared_ptr<Scheduler::Task> Scheduler::take(size_t index) {
+    // 先从自己队列的尾部取（LIFO，局部性好），再从其他队列的头部窃取
+    {
+        Queue &own = *queues[index];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (!own.tasks.empty()) {
+            std::shared_ptr<Task> task = own.tasks.back();
+            own.tasks.pop_back();
+            return task;
+        }
+    }
+    for (size_t k = 1; k < queues.size(); k++) {
+        Queue &victim = *queues[(index + k) % queues.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+            std::shared_ptr<Task> task = victim.tasks.front();
+            victim.tasks.pop_front();
+            return task;
+        }
+    }
+    return std::shared_ptr<Task>();
+}
+
+bool Scheduler::runOne() {
+    if (pending.load() == 0) return false;
+    size_t index = queue_index >= 0 ? (size_t)queue_index : queues.size() - 1;
+    std::shared_ptr<Task> task = take(index);
+    if (!task) return false;
+    pending.fetch_sub(1);
+    task->run();
+    return true;
+}
+
+void Scheduler::workerLoop(size_t index) {
+    queue_index = (int)index;
+    while (!stopping) {
+        if (runOne()) continue;
+        std::unique_lock<std::mutex> guard(idle_lock);
+        idle.wait(guard, [this]() { return stopping || pending.load() > 0; });
+    }
+}
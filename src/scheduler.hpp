@@ -0,0 +1,78 @@
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+/**
+ * @file scheduler.hpp
+ * @brief Work-stealing thread pool for parallel evaluation
+ *
+ * Every pool thread owns a deque: it pushes and pops its own tasks at the
+ * back and steals from the front of the others when it runs dry. Threads
+ * outside the pool share one extra deque. A thread waiting for a result
+ * does not block; it keeps running queued tasks until the result is ready,
+ * so nested parallel calls cannot exhaust the pool. While idle it polls
+ * for safepoint requests, so a waiting caller can still be interrupted.
+ */
+
+#include "safepoint.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class Scheduler {
+public:
+    struct Task {
+        virtual ~Task() {}
+        virtual void run() = 0;
+    };
+
+    // Sets the total number of threads (callers included); must precede the first use
+    static void configure(int threads);
+    static Scheduler &instance();
+
+    int threads() const;
+    void spawn(const std::shared_ptr<Task> &);
+    bool runOne();              ///< Runs one queued task if there is any
+    bool localQueueEmpty();     ///< True when nothing is waiting in the caller's own deque
+
+    // Runs queued tasks on the calling thread until done() holds
+    template <class Pred>
+    void helpUntil(Pred done) {
+        int idle = 0;
+        while (!done()) {
+            if (runOne()) {
+                idle = 0;
+            } else if (++idle < 64) {
+                std::this_thread::yield();
+            } else {
+                safepointPoll();
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        }
+    }
+
+    ~Scheduler();
+
+private:
+    explicit Scheduler(int threads);
+    void workerLoop(size_t index);
+    std::shared_ptr<Task> take(size_t index);
+
+    struct Queue {
+        std::mutex lock;
+        std::deque<std::shared_ptr<Task>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;   ///< One per pool thread, plus a shared one for outside threads
+    std::vector<std::thread> pool;
+    std::atomic<int> pending;
+    std::atomic<bool> stopping;
+    std::mutex idle_lock;
+    std::condition_variable idle;
+};
+
+#endif // SCHEDULER_HPP
@@ -3,6 +3,8 @@
 #include <vector>
 #include "RE.hpp"
 
+thread_local int reader_line = 1;
+
 Syntax::Syntax(SyntaxBase *stx) : ptr(stx) {}
 SyntaxBase* Syntax::operator->() const { return ptr.get(); }
 SyntaxBase& Syntax::operator*() { return *ptr; }
@@ -36,7 +38,7 @@ void StringSyntax::show(std::ostream &os) {
     os << "\"" << s << "\"";
 }
 
-List::List() {}
+List::List() : line(0) {}
 void List::show(std::ostream &os) {
     os << '(';
     for (auto stx : stxs) {
@@ -49,8 +51,10 @@ void List::show(std::ostream &os) {
 std::istream &readSpace(std::istream &is) {
   while (true) {
     // 跳过空白字符
-    while (isspace(is.peek()))
-      is.get();
+    while (isspace(is.peek())) {
+      if (is.get() == '\n')
+        reader_line++;
+    }
     
     // 检查是否是注释
     if (is.peek() == ';') {
@@ -134,8 +138,11 @@ Syntax createIdentifierSyntax(const std::string &s) {
 // no leading space
 Syntax readItem(std::istream &is) {
   if (is.peek() == '(' || is.peek() == '[') {
+    int line = reader_line;
     is.get();
-    return readList(is);
+    Syntax list = readList(is);
+    static_cast<List*>(list.get())->line = line;
+    return list;
   }
   if (is.peek() == '\'')
   {
@@ -156,6 +163,8 @@ Syntax readItem(std::istream &is) {
     std::string str;
     while (is.peek() != '"' && is.peek() != EOF) {
       char c = is.get();
+      if (c == '\n')
+        reader_line++;
       if (c == '\\') {
         // 处理转义字符
         char next = is.get();
@@ -209,8 +218,13 @@ Syntax readItem(std::istream &is) {
 
 Syntax readList(std::istream &is) {
     List *stx = new List();
-    while (readSpace(is).peek() != ')' && readSpace(is).peek() != ')')
+    while (readSpace(is).peek() != ')' && readSpace(is).peek() != ')') {
+        if (is.peek() == EOF) {
+            delete stx;
+            throw RuntimeError("Unexpected end of input");
+        }
         stx->stxs.push_back(readItem(is));
+    }
     is.get(); // ')'
     return Syntax(stx);
 }
@@ -65,11 +65,26 @@ struct StringSyntax : SyntaxBase {
 
 struct List : SyntaxBase {
     std::vector<Syntax> stxs;
+    int line;   // 左括号所在的行，0 表示未知
     List();
     virtual Expr parse(Assoc &) override;
+    Expr parseForm(Assoc &);
     virtual void show(std::ostream &) override;
 };
 
+// Line the reader is at, counted from 1 in each ReaderLines scope
+extern thread_local int reader_line;
+
+/**
+ * @brief Restarts line numbering for one source, restoring the outer count on exit
+ */
+struct ReaderLines {
+    int saved;
+    ReaderLines() : saved(reader_line) { reader_line = 1; }
+    ~ReaderLines() { reader_line = saved; }
+};
+
+std::istream &readSpace(std::istream &);
 Syntax readSyntax(std::istream &);
 
 std::istream &operator>>(std::istream &, Syntax);
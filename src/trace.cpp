@@ -0,0 +1,266 @@
+/**
+ * @file trace.cpp
+ * @brief Implementation of the trace-event export
+ */
+
+#include "trace.hpp"
+#include "profile.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <ctime>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+bool tracing = false;
+
+namespace {
+
+struct TraceEvent {
+    char phase;                 ///< 'B', 'E' or 'X'
+    int line;                   ///< Line of a top-level form
+    const std::string *name;    ///< Interned label of a call, never freed
+    unsigned long long ts;      ///< Nanoseconds since tracing started
+    unsigned long long dur;
+};
+
+const size_t RING_SIZE = 4096;  // 必须是 2 的幂
+const int END_RETRIES = 1000;
+
+/**
+ * @brief Single-producer single-consumer ring of one evaluating thread
+ *
+ * The owner writes a slot and then publishes it by advancing head; the
+ * flusher reads a slot and then releases it by advancing tail. Each index
+ * has a single writer, so neither side takes a lock.
+ */
+struct TraceRing {
+    std::atomic<size_t> head;
+    char head_pad[64];
+    std::atomic<size_t> tail;
+    char tail_pad[64];
+    std::atomic<bool> retired;          ///< The owner has exited; freed once drained
+    std::atomic<unsigned long> dropped;
+    int tid;
+    bool named;                         ///< thread_name metadata written
+    TraceEvent slots[RING_SIZE];
+
+    explicit TraceRing(int tid) : head(0), tail(0), retired(false), dropped(0), tid(tid), named(false) {}
+
+    bool push(const TraceEvent &e) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == RING_SIZE) return false;
+        slots[h & (RING_SIZE - 1)] = e;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(TraceEvent &e) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) return false;
+        e = slots[t & (RING_SIZE - 1)];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+/**
+ * @brief Rings, output file and flusher, never destroyed
+ */
+struct Tracer {
+    std::mutex lock;                    ///< Guards everything below
+    std::vector<TraceRing *> rings;
+    FILE *out;
+    bool first_event;
+    bool stop;
+    std::condition_variable wakeup;
+    std::thread *flusher;
+    unsigned long dropped;              ///< Drops of rings already freed
+    int next_tid;
+    int pid;
+    Tracer() : out(nullptr), first_event(true), stop(false), flusher(nullptr), dropped(0), next_tid(0), pid(0) {}
+};
+
+Tracer &tracer() {
+    static Tracer *instance = new Tracer();
+    return *instance;
+}
+
+unsigned long long start_ns = 0;
+unsigned long long threshold_ns = 0;
+
+unsigned long long nowNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+thread_local TraceRing *thread_ring = nullptr;
+
+// Hands the ring to the flusher when the thread exits
+struct Release {
+    ~Release() {
+        thread_ring->retired.store(true, std::memory_order_release);
+        thread_ring = nullptr;
+    }
+};
+
+TraceRing &threadRing() {
+    if (thread_ring == nullptr) {
+        Tracer &t = tracer();
+        std::lock_guard<std::mutex> guard(t.lock);
+        thread_ring = new TraceRing(++t.next_tid);
+        t.rings.push_back(thread_ring);
+        static thread_local Release release;
+        (void)release;
+    }
+    return *thread_ring;
+}
+
+void writeName(FILE *out, const std::string &name) {
+    fputc('"', out);
+    for (char c : name) {
+        if (c == '"' || c == '\\') fputc('\\', out);
+        if ((unsigned char)c < 0x20) fprintf(out, "\\u%04x", c);
+        else fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+void writeEvent(Tracer &t, int tid, const TraceEvent &e) {
+    fputs(t.first_event ? "\n" : ",\n", t.out);
+    t.first_event = false;
+    double ts = e.ts / 1000.0;
+    switch (e.phase) {
+        case 'B':
+            fprintf(t.out, "{\"name\": \"form\", \"cat\": \"form\", \"ph\": \"B\", \"ts\": %.3f, \"pid\": %d, "
+                           "\"tid\": %d, \"args\": {\"line\": %d}}", ts, t.pid, tid, e.line);
+            break;
+        case 'E':
+            fprintf(t.out, "{\"ph\": \"E\", \"ts\": %.3f, \"pid\": %d, \"tid\": %d}", ts, t.pid, tid);
+            break;
+        default:
+            fputs("{\"name\": ", t.out);
+            writeName(t.out, *e.name);
+            fprintf(t.out, ", \"cat\": \"call\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": %d, \"tid\": %d}",
+                    ts, e.dur / 1000.0, t.pid, tid);
+    }
+}
+
+// Writes every event published so far and frees the rings of exited threads
+void drain(Tracer &t) {
+    for (size_t i = 0; i < t.rings.size();) {
+        TraceRing *ring = t.rings[i];
+        bool retired = ring->retired.load(std::memory_order_acquire);
+        if (!ring->named) {
+            fputs(t.first_event ? "\n" : ",\n", t.out);
+            t.first_event = false;
+            fprintf(t.out, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, "
+                           "\"args\": {\"name\": \"thread %d\"}}", t.pid, ring->tid, ring->tid);
+            ring->named = true;
+        }
+        TraceEvent e;
+        while (ring->pop(e)) writeEvent(t, ring->tid, e);
+        if (retired) {
+            t.dropped += ring->dropped.load();
+            delete ring;
+            t.rings.erase(t.rings.begin() + i);
+        } else {
+            i++;
+        }
+    }
+}
+
+void flushLoop() {
+    Tracer &t = tracer();
+    std::unique_lock<std::mutex> guard(t.lock);
+    while (!t.stop) {
+        drain(t);
+        fflush(t.out);
+        t.wakeup.wait_for(guard, std::chrono::milliseconds(10));
+    }
+}
+
+void record(const TraceEvent &e) {
+    TraceRing &ring = threadRing();
+    if (!ring.push(e)) ring.dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+} // namespace
+
+bool startTracing(const std::string &path, unsigned long threshold_us) {
+    Tracer &t = tracer();
+    t.out = fopen(path.c_str(), "w");
+    if (t.out == nullptr) return false;
+    fputs("[", t.out);
+    t.pid = getpid();
+    start_ns = nowNs();
+    enableLabels();
+    threshold_ns = threshold_us * 1000ULL;
+    tracing = true;
+    // 线程对象不析构，提前退出的路径不会因为它仍可 join 而终止进程
+    t.flusher = new std::thread(flushLoop);
+    return true;
+}
+
+void stopTracing(std::ostream &os) {
+    Tracer &t = tracer();
+    if (t.flusher == nullptr) return;
+    {
+        std::lock_guard<std::mutex> guard(t.lock);
+        t.stop = true;
+        t.wakeup.notify_one();
+    }
+    t.flusher->join();
+    t.flusher = nullptr;
+    std::lock_guard<std::mutex> guard(t.lock);
+    drain(t);
+    unsigned long dropped = t.dropped;
+    for (TraceRing *ring : t.rings) dropped += ring->dropped.load();
+    fputs("\n]\n", t.out);
+    fclose(t.out);
+    t.out = nullptr;
+    if (dropped != 0)
+        os << "trace: " << dropped << " events dropped, rings were full" << std::endl;
+}
+
+Value tracedCall(Procedure *proc, Assoc &env) {
+    struct CallEvent {
+        const std::string *label;
+        unsigned long long start;
+        explicit CallEvent(const std::string *label) : label(label), start(nowNs()) {}
+        ~CallEvent() {
+            unsigned long long end = nowNs();
+            if (end - start < threshold_ns) return;
+            static const std::string *anonymous = procedureLabel("", 0);
+            record(TraceEvent{'X', 0, label != nullptr ? label : anonymous, start - start_ns, end - start});
+        }
+    } event(proc->label);
+    if (profilingEnabled())
+        return profiledCall(proc, env);
+    return proc->e->eval(env);
+}
+
+TraceScope::TraceScope(int line) : active(false), line(line) {
+    if (!tracing) return;
+    // 开始事件丢失时也不写结束事件，保持配对
+    active = threadRing().push(TraceEvent{'B', line, nullptr, nowNs() - start_ns, 0});
+    if (!active) thread_ring->dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+TraceScope::~TraceScope() {
+    if (!active) return;
+    TraceEvent e = {'E', line, nullptr, nowNs() - start_ns, 0};
+    TraceRing &ring = threadRing();
+    // 环满时等待刷写线程腾出位置，否则开始事件将没有结束
+    for (int i = 0; !ring.push(e); i++) {
+        if (i == END_RETRIES) {
+            ring.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        std::this_thread::yield();
+    }
+}
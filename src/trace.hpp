@@ -0,0 +1,55 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+/**
+ * @file trace.hpp
+ * @brief Chrome trace-event export of top-level forms and procedure calls (--trace)
+ *
+ * With --trace FILE every top-level form evaluated by the REPL or by
+ * Interpreter::eval (one per worker request) gets a begin and an end
+ * event, and every application of a compound procedure that takes at
+ * least --trace-threshold-us microseconds (100 by default, 0 for all)
+ * gets a complete event named by its label (see profile.hpp). FILE is in
+ * the JSON array format of the Chrome trace-event spec and opens in
+ * Perfetto or chrome://tracing; it stays readable if the process dies
+ * before the closing bracket is written.
+ *
+ * An evaluating thread only writes fixed-size events into its own
+ * single-producer ring; a flusher thread drains all rings every few
+ * milliseconds and does the formatting and file output. A call event is
+ * dropped when its ring is full, and the count of drops is printed at
+ * exit. Call durations include time spent in other green threads
+ * scheduled while the call was suspended.
+ *
+ * When it is off each procedure application pays one predictable branch.
+ */
+
+#include "value.hpp"
+#include <ostream>
+#include <string>
+
+extern bool tracing;
+
+// Opens path and starts the flusher; calls shorter than threshold_us are not recorded
+bool startTracing(const std::string &path, unsigned long threshold_us);
+
+// Drains the rings, closes the file and reports dropped events on os
+void stopTracing(std::ostream &os);
+
+// Evaluates the body of an applied procedure in its parameter frame, recording it if slow enough
+Value tracedCall(Procedure *proc, Assoc &env);
+
+/**
+ * @brief Begin and end events of one top-level form
+ */
+class TraceScope {
+public:
+    explicit TraceScope(int line);
+    ~TraceScope();
+
+private:
+    bool active;
+    int line;
+};
+
+#endif // TRACE_HPP
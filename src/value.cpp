@@ -7,6 +7,12 @@
  */
 
 #include "value.hpp"
+#include "purity.hpp"
+#include "limits.hpp"
+#include "allocation.hpp"
+#include "envstats.hpp"
+#include "RE.hpp"
+#include <atomic>
 
 // ============================================================================
 // Base ValueBase Implementation
@@ -46,8 +52,61 @@ void Value::show(std::ostream &os) {
 // Environment (Association List) Implementation
 // ============================================================================
 
+// Generation stamped on new nodes; every snapshot starts a new one
+static std::atomic<unsigned long> current_generation(1);
+// 求值路径只读裸指针；owner 保证任务持有期间 overlay 不被释放
+static thread_local EnvOverlay *active_overlay = nullptr;
+static thread_local std::shared_ptr<EnvOverlay> active_overlay_owner;
+
 AssocList::AssocList(const std::string &x, const Value &v, Assoc &next)
-    : x(x), v(v), next(next) {}
+    : x(x), v(v), next(next), generation(current_generation.load(std::memory_order_relaxed)) {}
+
+static bool isFrozen(const EnvOverlay *overlay, const AssocList *node) {
+    return node->generation <= overlay->frozen;
+}
+
+unsigned long freezeEnvironments() {
+    return current_generation.fetch_add(1);
+}
+
+std::shared_ptr<EnvOverlay> copyOverlay(const EnvOverlay &overlay) {
+    std::shared_ptr<EnvOverlay> copy = std::make_shared<EnvOverlay>(overlay);
+    copy->record_writes = true;
+    copy->written.clear();
+    return copy;
+}
+
+void mergeOverlay(EnvOverlay &into, const EnvOverlay &task) {
+    for (const AssocList *key : task.written) {
+        const EnvOverlay::Binding &b = task.values.find(key)->second;
+        auto slot = into.values.insert({key, b});
+        if (!slot.second) slot.first->second.v = b.v;
+        if (into.record_writes) into.written.insert(key);
+    }
+}
+
+std::shared_ptr<EnvOverlay> activeOverlay() {
+    return active_overlay_owner;
+}
+
+void setActiveOverlay(const std::shared_ptr<EnvOverlay> &overlay) {
+    active_overlay_owner = overlay;
+    active_overlay = overlay.get();
+}
+
+void checkPairMutable(const Pair *pair, const char *who) {
+    // 与其他会话共享的序对没有写时复制，修改它们是数据竞争
+    if (active_overlay != nullptr && pair->generation <= active_overlay->shared_pairs)
+        throw RuntimeError(std::string(who) + ": pair is shared with other sessions");
+}
+
+Value bindingValue(const AssocList *node) {
+    if (active_overlay != nullptr && !active_overlay->values.empty() && isFrozen(active_overlay, node)) {
+        auto it = active_overlay->values.find(node);
+        if (it != active_overlay->values.end()) return it->second.v;
+    }
+    return node->v;
+}
 
 Assoc::Assoc(AssocList *x) : ptr(x) {}
 
@@ -63,27 +122,71 @@ AssocList* Assoc::get() const {
     return ptr.get(); 
 }
 
+// Counted for allocation-stats and charged against the heap quota
+static inline void noteAllocation(int kind, size_t bytes) {
+    countAllocation(kind, bytes);
+    chargeHeap(bytes);
+}
+
 Assoc empty() {
     return Assoc(nullptr);
 }
 
 Assoc extend(const std::string &x, const Value &v, Assoc &lst) {
+    noteAllocation(ALLOC_FRAME, sizeof(AssocList));
     return Assoc(new AssocList(x, v, lst));
 }
 
+static void storeBinding(const Assoc &node, const Value &v) {
+    // 快照中的绑定写入当前会话的 overlay，不修改共享节点
+    if (active_overlay != nullptr && isFrozen(active_overlay, node.get())) {
+        auto slot = active_overlay->values.insert({node.get(), EnvOverlay::Binding{node, v}});
+        if (!slot.second) slot.first->second.v = v;
+        if (active_overlay->record_writes) active_overlay->written.insert(node.get());
+    } else {
+        node->v = v;
+    }
+}
+
+// The walk of find and modify under --env-stats, counting the nodes passed (see envstats.hpp)
+static Assoc countedWalk(const std::string &x, const Assoc &lst, bool update) {
+    unsigned long hops = 0;
+    for (auto i = lst; i.get() != nullptr; i = i->next, hops++) {
+        if (x == i->x) {
+            countLookup(x, hops, true, update);
+            return i;
+        }
+    }
+    countLookup(x, hops, false, update);
+    return Assoc(nullptr);
+}
+
 void modify(const std::string &x, const Value &v, Assoc &lst) {
+    if (__builtin_expect(env_stats, 0)) {
+        Assoc node = countedWalk(x, lst, true);
+        if (node.get() != nullptr) {
+            noteRebinding(x, bindingValue(node.get()));
+            storeBinding(node, v);
+        }
+        return;
+    }
     for (auto i = lst; i.get() != nullptr; i = i->next) {
         if (x == i->x) {
-            i->v = v;
+            noteRebinding(x, bindingValue(i.get()));
+            storeBinding(i, v);
             return;
         }
     }
 }
 
 Value find(const std::string &x, Assoc &l) {
+    if (__builtin_expect(env_stats, 0)) {
+        Assoc node = countedWalk(x, l, false);
+        return node.get() != nullptr ? bindingValue(node.get()) : Value(nullptr);
+    }
     for (auto i = l; i.get() != nullptr; i = i->next) {
         if (x == i->x) {
-            return i->v;
+            return bindingValue(i.get());
         }
     }
     return Value(nullptr);
@@ -101,6 +204,7 @@ void Void::show(std::ostream &os) {
 }
 
 Value VoidV() {
+    noteAllocation(V_VOID, sizeof(Void));
     return Value(new Void());
 }
 
@@ -112,6 +216,7 @@ void Integer::show(std::ostream &os) {
 }
 
 Value IntegerV(int n) {
+    noteAllocation(V_INT, sizeof(Integer));
     return Value(new Integer(n));
 }
 
@@ -154,6 +259,7 @@ void Rational::show(std::ostream &os) {
 }
 
 Value RationalV(int num, int den) {
+    noteAllocation(V_RATIONAL, sizeof(Rational));
     return Value(new Rational(num, den));
 }
 
@@ -165,6 +271,7 @@ void Boolean::show(std::ostream &os) {
 }
 
 Value BooleanV(bool b) {
+    noteAllocation(V_BOOL, sizeof(Boolean));
     return Value(new Boolean(b));
 }
 
@@ -176,6 +283,7 @@ void Symbol::show(std::ostream &os) {
 }
 
 Value SymbolV(const std::string &s) {
+    noteAllocation(V_SYM, sizeof(Symbol));
     return Value(new Symbol(s));
 }
 
@@ -187,6 +295,7 @@ void String::show(std::ostream &os) {
 }
 
 Value StringV(const std::string &s) {
+    noteAllocation(V_STRING, sizeof(String) + s.size());
     return Value(new String(s));
 }
 
@@ -206,6 +315,7 @@ void Null::showCdr(std::ostream &os) {
 }
 
 Value NullV() {
+    noteAllocation(V_NULL, sizeof(Null));
     return Value(new Null());
 }
 
@@ -217,6 +327,7 @@ void Terminate::show(std::ostream &os) {
 }
 
 Value TerminateV() {
+    countAllocation(V_TERMINATE, sizeof(Terminate));
     return Value(new Terminate());
 }
 
@@ -226,7 +337,7 @@ Value TerminateV() {
 
 // Pair
 Pair::Pair(const Value &car, const Value &cdr) 
-    : ValueBase(V_PAIR), car(car), cdr(cdr) {}
+    : ValueBase(V_PAIR), car(car), cdr(cdr), generation(current_generation.load(std::memory_order_relaxed)) {}
 
 void Pair::show(std::ostream &os) {
     os << '(' << car;
@@ -239,19 +350,46 @@ void Pair::showCdr(std::ostream &os) {
 }
 
 Value PairV(const Value &car, const Value &cdr) {
+    noteAllocation(V_PAIR, sizeof(Pair));
     return Value(new Pair(car, cdr));
 }
 
 // Procedure
-Procedure::Procedure(const std::vector<std::string> &xs, const Expr &e, const Assoc &env)
-    : ValueBase(V_PROC), parameters(xs), e(e), env(env) {}
+Procedure::Procedure(const std::vector<std::string> &xs, const Expr &e, const Assoc &env, const std::string *label)
+    : ValueBase(V_PROC), parameters(xs), e(e), env(env), analysis(0), label(label) {}
 
 void Procedure::show(std::ostream &os) {
     os << "#<procedure>";
 }
 
-Value ProcedureV(const std::vector<std::string> &xs, const Expr &e, const Assoc &env) {
-    return Value(new Procedure(xs, e, env));
+Value ProcedureV(const std::vector<std::string> &xs, const Expr &e, const Assoc &env, const std::string *label) {
+    noteAllocation(V_PROC, sizeof(Procedure));
+    return Value(new Procedure(xs, e, env, label));
+}
+
+// Primitive
+Primitive::Primitive(const std::string &name, PrimitiveFn fn, int min_arity, int max_arity)
+    : ValueBase(V_PRIMITIVE), name(name), fn(fn), min_arity(min_arity), max_arity(max_arity) {}
+
+void Primitive::show(std::ostream &os) {
+    os << "#<procedure>";
+}
+
+Value PrimitiveV(const std::string &name, PrimitiveFn fn, int min_arity, int max_arity) {
+    countAllocation(V_PRIMITIVE, sizeof(Primitive));
+    return Value(new Primitive(name, fn, min_arity, max_arity));
+}
+
+// Future
+Future::Future(const std::shared_ptr<FutureState> &state) : ValueBase(V_FUTURE), state(state) {}
+
+void Future::show(std::ostream &os) {
+    os << "#<future>";
+}
+
+Value FutureV(const std::shared_ptr<FutureState> &state) {
+    noteAllocation(V_FUTURE, sizeof(Future));
+    return Value(new Future(state));
 }
 
 // ============================================================================
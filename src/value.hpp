@@ -11,9 +11,12 @@
 
 #include "Def.hpp"
 #include "expr.hpp"
+#include <atomic>
 #include <memory>
 #include <cstring>
 #include <vector>
+#include <unordered_map>
+#include <unordered_set>
 
 // ============================================================================
 // Base classes and smart pointer wrappers
@@ -64,9 +67,54 @@ struct AssocList {
     std::string x;      ///< Variable name
     Value v;            ///< Variable value
     Assoc next;         ///< Next binding in the chain
+    unsigned long generation;   ///< Snapshot generation the node was created in
     AssocList(const std::string &, const Value &, Assoc &);
 };
 
+/**
+ * @brief Private copies of the bindings one session has written
+ *
+ * freezeEnvironments() takes an O(1) snapshot and returns its generation;
+ * an overlay whose frozen generation is at least that of a node treats the
+ * node as copy-on-write. While an overlay is active, writes to such a node
+ * land in the overlay and reads consult it first, so sessions share the
+ * unchanged bindings and only copy the ones they set. Nodes created after
+ * the overlay's snapshot are private to it and updated in place; another
+ * session forking later does not change that. An entry holds its node, so
+ * the address it is keyed by cannot be reused while the entry exists.
+ *
+ * Pairs are stamped with a generation as well. Pairs a forked session
+ * shares with others are read-only in it: set-car!/set-cdr! on them
+ * fail, since copying reachable data on write is not possible without
+ * knowing who refers to it. Parallel ranges keep the pair generation of
+ * their session, so they may still mutate the session's own data.
+ *
+ * A task (future or parallel range) runs on a private copy made by
+ * copyOverlay(), which also records the nodes the task writes, so they
+ * can be merged back into the session's overlay or reported.
+ */
+struct EnvOverlay {
+    struct Binding {
+        Assoc node;     ///< Keeps the key alive
+        Value v;
+    };
+    unsigned long frozen;       ///< Nodes of generation <= frozen belong to the snapshot
+    unsigned long shared_pairs; ///< Pairs of generation <= shared_pairs are read-only (0: none)
+    std::unordered_map<const AssocList *, Binding> values;
+    bool record_writes;         ///< Copy of a task: writes are noted in written
+    std::unordered_set<const AssocList *> written;  ///< Keys of values set since the copy was made
+    EnvOverlay(unsigned long frozen, unsigned long shared_pairs)
+        : frozen(frozen), shared_pairs(shared_pairs), record_writes(false) {}
+};
+unsigned long freezeEnvironments();
+std::shared_ptr<EnvOverlay> copyOverlay(const EnvOverlay &);      ///< Private copy for a task
+void mergeOverlay(EnvOverlay &into, const EnvOverlay &task);      ///< Applies the writes of a task's copy
+std::shared_ptr<EnvOverlay> activeOverlay();   ///< Tasks hold it so the view outlives its session
+void setActiveOverlay(const std::shared_ptr<EnvOverlay> &);
+Value bindingValue(const AssocList *);  ///< Value of a node as seen by the active overlay
+struct Pair;
+void checkPairMutable(const Pair *, const char *who);  ///< Throws if the pair is shared with other sessions
+
 // Environment operations
 Assoc empty();
 Assoc extend(const std::string&, const Value &, Assoc &);
@@ -170,6 +218,7 @@ Value TerminateV();
 struct Pair : ValueBase {
     Value car;  ///< First element
     Value cdr;  ///< Second element
+    unsigned long generation;   ///< Snapshot generation the pair was created in
     Pair(const Value &, const Value &);
     virtual void show(std::ostream &) override;
     virtual void showCdr(std::ostream &) override;
@@ -183,10 +232,48 @@ struct Procedure : ValueBase {
     std::vector<std::string> parameters;   ///< Parameter names
     Expr e;                                ///< Function body expression
     Assoc env;                             ///< Closure environment
-    Procedure(const std::vector<std::string> &, const Expr &, const Assoc &);
+    std::atomic<unsigned long long> analysis;  ///< Cached effect analysis, 0 if none (see purity.hpp)
+    const std::string *label;              ///< Profiler name of the lambda, nullptr if unnamed
+    Procedure(const std::vector<std::string> &, const Expr &, const Assoc &, const std::string *label = nullptr);
     virtual void show(std::ostream &) override;
 };
-Value ProcedureV(const std::vector<std::string> &, const Expr &, const Assoc &);
+Value ProcedureV(const std::vector<std::string> &, const Expr &, const Assoc &, const std::string *label = nullptr);
+
+/**
+ * @brief Native entry point of a primitive procedure
+ *
+ * Receives the already evaluated arguments; the arity has been checked by
+ * the caller against the range stored in the Primitive value.
+ */
+typedef Value (*PrimitiveFn)(const std::vector<Value> &);
+
+/**
+ * @brief Primitive (built-in) procedure value
+ */
+struct Primitive : ValueBase {
+    std::string name;   ///< Name the primitive is bound to
+    PrimitiveFn fn;     ///< C++ implementation
+    int min_arity;      ///< Minimum number of arguments
+    int max_arity;      ///< Maximum number of arguments, -1 if variadic
+    Primitive(const std::string &, PrimitiveFn, int, int);
+    virtual void show(std::ostream &) override;
+};
+Value PrimitiveV(const std::string &, PrimitiveFn, int, int);
+
+struct FutureState;
+
+/**
+ * @brief Placeholder for the result of a (future expr), see future.hpp
+ */
+struct Future : ValueBase {
+    std::shared_ptr<FutureState> state;
+    Future(const std::shared_ptr<FutureState> &);
+    virtual void show(std::ostream &) override;
+};
+Value FutureV(const std::shared_ptr<FutureState> &);
+
+// Procedure application (closures and primitives)
+Value applyProcedure(const Value &, const std::vector<Value> &);
 
 // ============================================================================
 // Utility Functions
@@ -0,0 +1,267 @@
+/**
+ * @file worker.cpp
+ * @brief Implementation of the persistent worker mode
+ */
+
+#include "worker.hpp"
+#include <sstream>
+#include <vector>
+#include <map>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <iostream>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+const size_t FRAME_HEADER = 4;
+
+// A connection is not read from while this much of its output is still unsent
+const size_t MAX_PENDING_OUTPUT = 1024 * 1024;
+
+uint32_t decodeLength(const char *p) {
+    const unsigned char *u = reinterpret_cast<const unsigned char *>(p);
+    return ((uint32_t)u[0] << 24) | ((uint32_t)u[1] << 16) | ((uint32_t)u[2] << 8) | (uint32_t)u[3];
+}
+
+std::string encodeFrame(const std::string &payload) {
+    uint32_t n = (uint32_t)payload.size();
+    std::string frame;
+    frame.reserve(FRAME_HEADER + payload.size());
+    frame.push_back((char)(n >> 24));
+    frame.push_back((char)(n >> 16));
+    frame.push_back((char)(n >> 8));
+    frame.push_back((char)n);
+    frame.append(payload);
+    return frame;
+}
+
+bool writeAll(int fd, const std::string &data) {
+    const char *p = data.data();
+    size_t left = data.size();
+    while (left > 0) {
+        ssize_t n = write(fd, p, left);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += n;
+        left -= n;
+    }
+    return true;
+}
+
+/**
+ * @brief Reassembles frames from the bytes of one connection
+ */
+struct FrameReader {
+    std::string pending;
+
+    // Appends input; returns false once a frame header exceeds the limit
+    bool feed(const char *data, size_t n, size_t max_request_bytes) {
+        pending.append(data, n);
+        return !(max_request_bytes != 0 && pending.size() >= FRAME_HEADER &&
+                 decodeLength(pending.data()) > max_request_bytes);
+    }
+
+    bool next(std::string &payload) {
+        if (pending.size() < FRAME_HEADER) return false;
+        uint32_t n = decodeLength(pending.data());
+        if (pending.size() - FRAME_HEADER < n) return false;
+        payload.assign(pending, FRAME_HEADER, n);
+        pending.erase(0, FRAME_HEADER + n);
+        return true;
+    }
+};
+
+// Answers every complete frame buffered in reader; false if the peer went away
+bool answer(Interpreter &interp, FrameReader &reader, int out_fd) {
+    std::string request;
+    while (reader.next(request)) {
+        if (!writeAll(out_fd, encodeFrame(handleRequest(interp, request))))
+            return false;
+    }
+    return true;
+}
+
+std::string oversizeResponse() {
+    return encodeFrame("eRequest too large");
+}
+
+/**
+ * @brief Non-blocking socket connection with its unsent responses
+ */
+struct Connection {
+    FrameReader reader;
+    std::string output;
+    size_t written;      ///< Bytes of output already sent
+    bool closing;        ///< No more input is read; closed once output is sent
+    Connection() : written(0), closing(false) {}
+
+    bool wantsInput() const {
+        return !closing && output.size() - written < MAX_PENDING_OUTPUT;
+    }
+
+    // Sends as much output as the socket takes now; false if the peer went away
+    bool flush(int fd) {
+        while (written < output.size()) {
+            ssize_t n = write(fd, output.data() + written, output.size() - written);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                return false;
+            }
+            written += n;
+        }
+        if (written == output.size()) {
+            output.clear();
+            written = 0;
+        } else if (written >= 64 * 1024) {
+            // 已发送的前缀较长时再整理，避免每次部分写都移动整个缓冲区
+            output.erase(0, written);
+            written = 0;
+        }
+        return true;
+    }
+
+    // Reads what is available and queues the responses; false if the peer went away
+    bool receive(Interpreter &interp, int fd, std::vector<char> &chunk, size_t max_request_bytes) {
+        ssize_t n = read(fd, chunk.data(), chunk.size());
+        if (n < 0) return errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK;
+        if (n == 0) {
+            // 对端关闭写方向：已排队的响应仍然发完再关闭
+            closing = true;
+            return true;
+        }
+        if (!reader.feed(chunk.data(), n, max_request_bytes)) {
+            output += oversizeResponse();
+            closing = true;
+            return true;
+        }
+        std::string request;
+        while (reader.next(request))
+            output += encodeFrame(handleRequest(interp, request));
+        return true;
+    }
+};
+
+} // namespace
+
+std::string handleRequest(Interpreter &interp, const std::string &source) {
+    // 每个请求在全局环境的写时复制快照上求值，结束后整体丢弃
+    Interpreter session = interp.fork();
+    std::ostringstream out;
+    session.setOutput(&out);
+    std::string response;
+    try {
+        Value result = session.eval(source);
+        response = "o" + out.str();
+        if (result->v_type != V_VOID && result->v_type != V_TERMINATE) {
+            std::ostringstream shown;
+            result->show(shown);
+            response += shown.str();
+        }
+    } catch (const RuntimeError &err) {
+        response = "e" + err.message();
+    }
+    return response;
+}
+
+int serveFrames(Interpreter &interp, int in_fd, int out_fd, size_t max_request_bytes) {
+    FrameReader reader;
+    std::vector<char> chunk(64 * 1024);
+    while (1) {
+        ssize_t n = read(in_fd, chunk.data(), chunk.size());
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return 1;
+        }
+        if (n == 0) {
+            // 输入结束时残留半个帧视为错误
+            return reader.pending.empty() ? 0 : 1;
+        }
+        if (!reader.feed(chunk.data(), n, max_request_bytes)) {
+            writeAll(out_fd, oversizeResponse());
+            return 1;
+        }
+        if (!answer(interp, reader, out_fd))
+            return 1;
+    }
+}
+
+int serveSocket(Interpreter &interp, const std::string &path, size_t max_request_bytes) {
+    sockaddr_un addr;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "socket path too long: " << path << std::endl;
+        return 1;
+    }
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        std::cerr << "socket: " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strcpy(addr.sun_path, path.c_str());
+    unlink(path.c_str());
+    if (bind(listener, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(listener, 128) != 0) {
+        std::cerr << "cannot listen on " << path << ": " << std::strerror(errno) << std::endl;
+        close(listener);
+        return 1;
+    }
+    // 客户端中途断开时 write 返回 EPIPE，而不是终止整个进程
+    signal(SIGPIPE, SIG_IGN);
+
+    // 单线程事件循环：请求逐个求值；套接字非阻塞，响应先进入连接的输出缓冲区，
+    // 由 POLLOUT 驱动发送，一个不读取响应的客户端不会阻塞其他连接
+    std::map<int, Connection> clients;
+    std::vector<char> chunk(64 * 1024);
+    std::vector<pollfd> fds;
+    while (1) {
+        fds.clear();
+        fds.push_back({listener, POLLIN, 0});
+        for (auto &c : clients) {
+            short events = 0;
+            if (c.second.wantsInput()) events |= POLLIN;
+            if (!c.second.output.empty()) events |= POLLOUT;
+            fds.push_back({c.first, events, 0});
+        }
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "poll: " << std::strerror(errno) << std::endl;
+            break;
+        }
+        for (size_t i = 1; i < fds.size(); i++) {
+            if (fds[i].revents == 0) continue;
+            int fd = fds[i].fd;
+            Connection &c = clients[fd];
+            bool keep = !(fds[i].revents & (POLLERR | POLLNVAL));
+            if (keep && (fds[i].revents & (POLLIN | POLLHUP)) && c.wantsInput())
+                keep = c.receive(interp, fd, chunk, max_request_bytes);
+            // 新产生的响应立即尝试发送，写不完的部分等待 POLLOUT
+            if (keep) keep = c.flush(fd);
+            if (keep && c.closing && c.output.empty()) keep = false;
+            if (!keep) {
+                close(fd);
+                clients.erase(fd);
+            }
+        }
+        if (fds[0].revents & POLLIN) {
+            int fd = accept(listener, nullptr, nullptr);
+            if (fd >= 0) {
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                clients[fd];
+            }
+        }
+    }
+    for (auto &c : clients) close(c.first);
+    close(listener);
+    unlink(path.c_str());
+    return 1;
+}
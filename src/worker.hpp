@@ -0,0 +1,35 @@
+#ifndef WORKER_HPP
+#define WORKER_HPP
+
+/**
+ * @file worker.hpp
+ * @brief Persistent worker serving framed evaluation requests
+ *
+ * A worker keeps one interpreter alive with its prelude already loaded and
+ * answers requests until the input is closed. Every frame is a 4-byte
+ * big-endian payload length followed by the payload:
+ *
+ *   request:  Scheme source text, evaluated like a short script
+ *   response: one status byte, 'o' (ok) or 'e' (error), followed by the
+ *             program output and the printed value of the last form on
+ *             success, or the RuntimeError message on failure
+ *
+ * Each request runs in a child scope of the globals as they were when the
+ * worker started (see Interpreter::fork), so its top-level defines and
+ * set!s on prelude bindings are dropped once it finishes.
+ */
+
+#include "interpreter.hpp"
+#include <string>
+#include <cstddef>
+
+// Evaluates one request against the worker's globals and returns the response payload
+std::string handleRequest(Interpreter &interp, const std::string &source);
+
+// Serves frames read from in_fd, writing responses to out_fd, until end of input
+int serveFrames(Interpreter &interp, int in_fd, int out_fd, size_t max_request_bytes);
+
+// Serves frames on a Unix domain socket at path; only returns on a socket error
+int serveSocket(Interpreter &interp, const std::string &path, size_t max_request_bytes);
+
+#endif // WORKER_HPP